@@ -29,16 +29,41 @@
 #ifndef NOSOUND
 #include <SDL2/SDL_mixer.h>
 #endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 
 #ifndef DATA_PREFIX
 #define DATA_PREFIX "data/"
 #endif
 
+/* ("--renderer=sdl" needs SDL_RenderGeometry(), new in SDL 2.0.18, as is
+   SDL_RenderLogicalToWindow(); see warp_mouse()) */
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+#define RENDER_GEOMETRY
+#endif
+
 
 /* Constraints: */
 
 #define NUM_BULLETS 3
+#define DRAW_LIST_CMDS 4096     /* (To start with; see new_draw_cmd()) */
+#define MAX_THREADS 16
+#define DRAW_LIST_FRESH 4       /* (See publish_draw_list()) */
+#define MAX_GLYPH_SIZE 32
+#define MAX_GLYPH_RUNS 32768
+#define MAX_BIT_SEGS 4096
+#define MAX_QUADS 16384         /* (Per SDL_RenderGeometry() call) */
+#define NUM_SPARKLES 32         /* (Of each kind; see build_sparkles()) */
+#define SPARKLE_SIZE 10
+#define SPARKLE_CENTER 4
+#define NUM_PALETTE_GRAYS 64    /* (See build_palette()) */
+#define NUM_PALETTE_RAMP 32
+#define PALETTE_CUBE 5
 
 #ifndef EMBEDDED
 #define NUM_ASTEROIDS 20
@@ -49,6 +74,11 @@
 #endif
 
 #define AST_SIDES 6
+
+#define TRIG_STEPS 1024         /* (A power of two; see fast_sin()) */
+#define TRIG_PER_DEGREE 2913    /* (TRIG_STEPS / 360, in 1/1024ths) */
+#define MAX_POLY_VERTS 12       /* (The title screen's rock has the most) */
+#define NUM_ROTATIONS 360       /* (Degrees; see fast_cos()) */
 #ifndef EMBEDDED
 #define AST_RADIUS 10
 #define SHIP_RADIUS 20
@@ -62,24 +92,110 @@
 #define FPS 50
 
 #ifndef EMBEDDED
-#define WIDTH 640
-#define HEIGHT 480
+#define DEFAULT_WIDTH 640
+#define DEFAULT_HEIGHT 480
+#else
+#define DEFAULT_WIDTH 240
+#define DEFAULT_HEIGHT 320
+#endif
+
+#define MIN_WIDTH 240
+#define MIN_HEIGHT 240
+#define MAX_WIDTH 3840
+#define MAX_HEIGHT 2160
+
+
+/* The size everything's drawn at (and the size of the playfield), as set
+   by "--render-size"; the renderer scales it to fit the window: */
+
+int render_width, render_height;
+
+#define WIDTH render_width
+#define HEIGHT render_height
+
+
+/* Screen pixels: 32-bit ARGB8888 on the desktop, 16-bit RGB565 on EMBEDDED
+   (half as much memory to draw into, erase and upload): */
+
+#ifndef EMBEDDED
+typedef Uint32 pixel_type;
+#define SCREEN_FORMAT SDL_PIXELFORMAT_ARGB8888
+#define PIXEL(r, g, b) (0xFF000000 | ((r) << 16) | ((g) << 8) | (b))
 #else
-#define WIDTH 240
-#define HEIGHT 320
+typedef Uint16 pixel_type;
+#define SCREEN_FORMAT SDL_PIXELFORMAT_RGB565
+#define PIXEL(r, g, b) ((((r) >> 3) << 11) | (((g) >> 2) << 5) | ((b) >> 3))
 #endif
 
+/* (No layer is ever drawn in magenta, so it marks where one's see-through;
+   see draw_layer()) */
 
-Uint8 drawn_at[HEIGHT + 1][WIDTH + 1];
+#define LAYER_KEY PIXEL(255, 0, 255)
+
+
+/* Coverage: one bit per pixel, set wherever a line has been drawn this
+   frame (so drop shadows never land on lines).  Each row that gets drawn
+   on is flagged, along with the first and last words it touched, so only
+   those get looked at or cleared. */
+
+#define COVERAGE_WORDS ((WIDTH + 31) / 32)
+#define MAX_COVERAGE_WORDS ((MAX_WIDTH + 31) / 32)
+#define COVERED(x, y) \
+  (coverage[y][(x) >> 5] & ((Uint32) 1 << ((x) & 31)))
+
+Uint32 coverage[MAX_HEIGHT][MAX_COVERAGE_WORDS];
+Uint8 coverage_row_used[MAX_HEIGHT];
+Uint16 coverage_lo[MAX_HEIGHT], coverage_hi[MAX_HEIGHT];
+
+
+/* Dirty tiles: the screen, cut into bands of DIRTY_ROWS rows, and each
+   band into columns one coverage word (32 pixels) wide -- or, on screens
+   too wide for 32 of those, 2, 4, ... words wide; a band's bits say which
+   of its tiles were drawn on.  Only those get erased and uploaded (as a
+   few merged rectangles), unless there are so many that doing the whole
+   screen is cheaper. */
+
+#define DIRTY_ROWS 16
+#define NUM_DIRTY_BANDS ((HEIGHT + DIRTY_ROWS - 1) / DIRTY_ROWS)
+#define MAX_DIRTY_BANDS ((MAX_HEIGHT + DIRTY_ROWS - 1) / DIRTY_ROWS)
+#define DIRTY_COLUMN_WORDS (1 << dirty_shift)
+#define DIRTY_ALL ((Uint32) 0xFFFFFFFF >> (32 - dirty_columns))
+#define MAX_DIRTY_RECTS 64
+#define DIRTY_FULL_PERCENT 50
+
+int dirty_shift, dirty_columns;         /* (See setup_dirty_tiles()) */
+Uint32 drawn_tiles[MAX_DIRTY_BANDS];    /* (As of the last frame shown) */
+SDL_Rect dirty_rects[MAX_DIRTY_RECTS];
+
+int bit_position[32] = {
+  0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+  31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+};
 
 
 enum
 { FALSE, TRUE };
 
-#define LEFT_EDGE   0x0001
-#define RIGHT_EDGE  0x0002
-#define TOP_EDGE    0x0004
-#define BOTTOM_EDGE 0x0008
+
+/* Rasterizer thread jobs: */
+
+enum
+{
+  RASTER_LINES,
+  RASTER_SHADOWS,
+  RASTER_QUIT
+};
+
+
+/* Where an object is, relative to the screen (and its wrapped copies): */
+
+enum
+{
+  CULL_OUTSIDE,
+  CULL_EDGE,
+  CULL_INSIDE
+};
+
 
 
 /* Types: */
@@ -112,6 +228,15 @@ typedef struct asteroid_type
   shape_type shape[AST_SIDES];
 } asteroid_type;
 
+/* An asteroid's corners, as offsets from its center, at each whole degree
+   it can be turned to (see build_rock_verts()): */
+
+typedef struct rock_verts_type
+{
+  int built;
+  Sint8 x[AST_SIDES][NUM_ROTATIONS], y[AST_SIDES][NUM_ROTATIONS];
+} rock_verts_type;
+
 typedef struct bit_type
 {
   int timer;
@@ -126,6 +251,110 @@ typedef struct color_type
   Uint8 b;
 } color_type;
 
+/* A corner of an outline, around its center (see draw_polyline()): */
+
+typedef struct vertex_type
+{
+  int r, a;
+  color_type c;
+} vertex_type;
+
+/* A display list command: steps k0 through k1 of a line (see clip()),
+   or a glyph (character k0, at size k1) whose top left is at (x1, y1) and
+   bottom right is at (x2, y2), in color c1, or a sparkle (number k0) whose
+   top left and bottom right are there, or a batch of k1 short segments
+   (starting at the list's bit_segs[k0]) in color c1, within rows y1
+   through y2: */
+
+enum
+{
+  DRAW_LINE,
+  DRAW_GLYPH,
+  DRAW_SPARKLE,
+  DRAW_BITS
+};
+
+typedef struct draw_cmd_type
+{
+  Sint16 x1, y1, x2, y2;
+  Sint16 k0, k1;
+  color_type c1, c2;
+  Uint8 kind;
+} draw_cmd_type;
+
+/* A run of pixels in a cached glyph: "w" across or "h" down from (x, y),
+   relative to its top left: */
+
+typedef struct glyph_run_type
+{
+  Sint16 x, y, w, h;
+} glyph_run_type;
+
+/* A cached glyph: its runs, in "glyph_runs" (none yet if "num_runs" is 0;
+   -1 if there wasn't room): */
+
+typedef struct glyph_type
+{
+  int first, num_runs;
+} glyph_type;
+
+/* One way a bullet can sparkle: two crossed lines (thick ones, for the
+   bullet itself; thin, for its trail), from (x[0], y[0]) to (x[1], y[1])
+   and (x[2], y[2]) to (x[3], y[3]) around its center, and the screen pixels
+   they come out as, drawn with the center at (SPARKLE_CENTER,
+   SPARKLE_CENTER) (a pixel's bit in "mask" is set if it's drawn): */
+
+typedef struct sparkle_type
+{
+  int thick;
+  int x[4], y[4];
+  color_type c[4];
+  Uint16 mask[SPARKLE_SIZE];
+  pixel_type pixels[SPARKLE_SIZE][SPARKLE_SIZE];
+  Uint8 indices[SPARKLE_SIZE][SPARKLE_SIZE];    /* (With "--indexed") */
+} sparkle_type;
+
+/* A short segment, from (x, y) to (x + xm, y + ym), in a batch of them
+   (see draw_bit()): */
+
+typedef struct bit_seg_type
+{
+  Sint16 x, y, xm, ym;
+} bit_seg_type;
+
+/* A display list: one frame's worth of commands (and of short segments,
+   for its batches), and which of its commands, if any, are a layer's
+   (see end_layer()): */
+
+typedef struct draw_list_type
+{
+  draw_cmd_type *cmds;
+  int num_cmds, max_cmds;
+  bit_seg_type bit_segs[MAX_BIT_SEGS];
+  int num_bit_segs;
+  int layer_first, layer_cmds;
+  int layer_serial;             /* (0 if there's no layer) */
+} draw_list_type;
+
+/* A layer: the commands for a part of the screen that rarely changes (the
+   score, say), kept from frame to frame along with the values they were
+   drawn from (see begin_layer()), and a number that's new each time
+   they're recorded, so their pixels can be kept, too (see draw_layer()): */
+
+typedef struct layer_type
+{
+  draw_list_type list;
+  int key[4];
+  int valid;
+  int serial;
+} layer_type;
+
+typedef struct shade_type
+{
+  int r, g, b;                  /* 8.8 fixed-point color of the 1st pixel */
+  int rd, gd, bd;               /* ...and the step to each following pixel */
+} shade_type;
+
 
 /* Data: */
 
@@ -168,6 +397,29 @@ char *mus_game_name = DATA_PREFIX "music/decision.s3m";
 #endif
 
 
+/* Benchmark phases (see "--bench"): */
+
+enum
+{
+  BENCH_EVENTS,
+  BENCH_SIM,
+  BENCH_RECORD,
+  BENCH_RASTER,
+  BENCH_UPLOAD,
+  BENCH_PRESENT,
+  NUM_BENCH_PHASES
+};
+
+char *bench_phase_names[NUM_BENCH_PHASES] = {
+  "events",
+  "simulation",
+  "recording",
+  "rasterization",
+  "texture upload",
+  "present"
+};
+
+
 /* Globals: */
 
 SDL_Window *window;
@@ -176,6 +428,52 @@ SDL_Surface *bkgd;
 SDL_Texture *bkgdTexture;
 SDL_Surface *screen;
 SDL_Texture *screenTexture;
+pixel_type *screen_rows[MAX_HEIGHT];
+int screen_stride, screen_native;
+Uint32 shadow_pixel;
+int use_indexed;                /* (See setup_index_screen()) */
+SDL_Surface *index_screen, *index_bkgd;
+Uint8 *index_rows[MAX_HEIGHT];
+int index_stride;
+Uint8 shadow_index;
+pixel_type palette[256];
+Uint8 color_index[32][32][32];
+int zero_copy;
+int use_sdl_renderer;           /* (See render_draw_cmds()) */
+#ifdef RENDER_GEOMETRY
+SDL_Vertex quad_verts[MAX_QUADS * 4];
+#endif
+int quad_indices[MAX_QUADS * 6];
+int num_quads;
+int drawing_on_screen;          /* (Set while an object's known to fit) */
+int skipping_line_ends;         /* (Set while drawing joined edges) */
+draw_list_type draw_lists[3];   /* (See publish_draw_list()) */
+draw_list_type *record_list, *flush_list;
+int draw_list_back, draw_list_front;
+SDL_atomic_t draw_list_middle;
+SDL_atomic_t game_input, game_done;
+int game_quit, game_counter, firing, tap_area_brightness;
+layer_type hud_layer, title_layer;
+draw_list_type *layer_saved_list;
+int layer_serials;
+SDL_Surface *layer_surface;
+SDL_Texture *layerTexture;
+SDL_Rect layer_rect;            /* (Where the layer drawn last has pixels) */
+int layer_drawn_serial;
+Uint32 layer_coverage[MAX_HEIGHT][MAX_COVERAGE_WORDS];  /* (Its lines) */
+glyph_type glyphs[37][MAX_GLYPH_SIZE + 1];      /* (See find_glyph()) */
+glyph_run_type glyph_runs[MAX_GLYPH_RUNS];
+int num_glyph_runs;
+sparkle_type sparkles[NUM_SPARKLES * 2];        /* (Trails, then bullets) */
+Uint32 sparkle_seed;
+int num_threads, raster_threads, raster_job;
+int raster_top, raster_bottom;  /* (Rows being drawn; see band_top()) */
+SDL_Thread *raster_thread[MAX_THREADS];
+SDL_sem *raster_go[MAX_THREADS], *raster_done;
+int raster_band_num[MAX_THREADS];
+int *band_cmds[MAX_THREADS];    /* (Display list, binned) */
+int max_band_cmds;
+int num_band_cmds[MAX_THREADS];
 #ifndef NOSOUND
 Mix_Chunk *sounds[NUM_SOUNDS];
 Mix_Music *game_music;
@@ -185,29 +483,134 @@ SDL_Joystick *js;
 #endif
 bullet_type bullets[NUM_BULLETS];
 asteroid_type asteroids[NUM_ASTEROIDS];
+rock_verts_type rock_verts[NUM_ASTEROIDS];      /* (One per asteroid) */
 bit_type bits[NUM_BITS];
 int use_sound, use_joystick, fullscreen, text_zoom;
 char zoom_str[24];
 int x, y, xm, ym, angle;
 int player_alive, player_die_timer;
 int lives, score, high, level, game_pending;
+int bench_frames, bench_frames_done, seed, seed_set;
+int bench_segments, bench_segments_fast;
+Uint64 bench_uploaded, bench_copied;
+Uint64 bench_time[NUM_BENCH_PHASES], bench_last;
+
+
+/* The title screen's giant rock (radius, angle): */
+
+shape_type title_rock[12] = {
+  {40, 0}, {30, 30}, {40, 55}, {25, 90}, {40, 120}, {35, 130},
+  {40, 160}, {30, 200}, {45, 220}, {25, 265}, {30, 300}, {45, 335}
+};
 
 
-/* Trig junk:  (thanks to Atari BASIC for this) */
-
-int trig[12] = {
-  1024,
-  1014,
-  984,
-  935,
-  868,
-  784,
-  685,
-  572,
-  448,
-  316,
-  117,
-  0
+/* Sine, in 1/1024ths, for TRIG_STEPS steps around the circle (made with
+   round(1024 * sin(i * 2 * pi / 1024)); see fast_sin()): */
+
+Sint16 sine[TRIG_STEPS] = {
+  0, 6, 13, 19, 25, 31, 38, 44, 50, 57,
+  63, 69, 75, 82, 88, 94, 100, 107, 113, 119,
+  125, 132, 138, 144, 150, 156, 163, 169, 175, 181,
+  187, 194, 200, 206, 212, 218, 224, 230, 237, 243,
+  249, 255, 261, 267, 273, 279, 285, 291, 297, 303,
+  309, 315, 321, 327, 333, 339, 345, 351, 357, 363,
+  369, 374, 380, 386, 392, 398, 403, 409, 415, 421,
+  426, 432, 438, 443, 449, 455, 460, 466, 472, 477,
+  483, 488, 494, 499, 505, 510, 516, 521, 526, 532,
+  537, 543, 548, 553, 558, 564, 569, 574, 579, 584,
+  590, 595, 600, 605, 610, 615, 620, 625, 630, 635,
+  640, 645, 650, 654, 659, 664, 669, 674, 678, 683,
+  688, 692, 697, 702, 706, 711, 715, 720, 724, 729,
+  733, 737, 742, 746, 750, 755, 759, 763, 767, 771,
+  775, 779, 784, 788, 792, 796, 799, 803, 807, 811,
+  815, 819, 822, 826, 830, 834, 837, 841, 844, 848,
+  851, 855, 858, 862, 865, 868, 872, 875, 878, 882,
+  885, 888, 891, 894, 897, 900, 903, 906, 909, 912,
+  915, 917, 920, 923, 926, 928, 931, 934, 936, 939,
+  941, 944, 946, 948, 951, 953, 955, 958, 960, 962,
+  964, 966, 968, 970, 972, 974, 976, 978, 980, 982,
+  983, 985, 987, 989, 990, 992, 993, 995, 996, 998,
+  999, 1000, 1002, 1003, 1004, 1006, 1007, 1008, 1009, 1010,
+  1011, 1012, 1013, 1014, 1015, 1016, 1016, 1017, 1018, 1018,
+  1019, 1020, 1020, 1021, 1021, 1022, 1022, 1022, 1023, 1023,
+  1023, 1024, 1024, 1024, 1024, 1024, 1024, 1024, 1024, 1024,
+  1024, 1024, 1023, 1023, 1023, 1022, 1022, 1022, 1021, 1021,
+  1020, 1020, 1019, 1018, 1018, 1017, 1016, 1016, 1015, 1014,
+  1013, 1012, 1011, 1010, 1009, 1008, 1007, 1006, 1004, 1003,
+  1002, 1000, 999, 998, 996, 995, 993, 992, 990, 989,
+  987, 985, 983, 982, 980, 978, 976, 974, 972, 970,
+  968, 966, 964, 962, 960, 958, 955, 953, 951, 948,
+  946, 944, 941, 939, 936, 934, 931, 928, 926, 923,
+  920, 917, 915, 912, 909, 906, 903, 900, 897, 894,
+  891, 888, 885, 882, 878, 875, 872, 868, 865, 862,
+  858, 855, 851, 848, 844, 841, 837, 834, 830, 826,
+  822, 819, 815, 811, 807, 803, 799, 796, 792, 788,
+  784, 779, 775, 771, 767, 763, 759, 755, 750, 746,
+  742, 737, 733, 729, 724, 720, 715, 711, 706, 702,
+  697, 692, 688, 683, 678, 674, 669, 664, 659, 654,
+  650, 645, 640, 635, 630, 625, 620, 615, 610, 605,
+  600, 595, 590, 584, 579, 574, 569, 564, 558, 553,
+  548, 543, 537, 532, 526, 521, 516, 510, 505, 499,
+  494, 488, 483, 477, 472, 466, 460, 455, 449, 443,
+  438, 432, 426, 421, 415, 409, 403, 398, 392, 386,
+  380, 374, 369, 363, 357, 351, 345, 339, 333, 327,
+  321, 315, 309, 303, 297, 291, 285, 279, 273, 267,
+  261, 255, 249, 243, 237, 230, 224, 218, 212, 206,
+  200, 194, 187, 181, 175, 169, 163, 156, 150, 144,
+  138, 132, 125, 119, 113, 107, 100, 94, 88, 82,
+  75, 69, 63, 57, 50, 44, 38, 31, 25, 19,
+  13, 6, 0, -6, -13, -19, -25, -31, -38, -44,
+  -50, -57, -63, -69, -75, -82, -88, -94, -100, -107,
+  -113, -119, -125, -132, -138, -144, -150, -156, -163, -169,
+  -175, -181, -187, -194, -200, -206, -212, -218, -224, -230,
+  -237, -243, -249, -255, -261, -267, -273, -279, -285, -291,
+  -297, -303, -309, -315, -321, -327, -333, -339, -345, -351,
+  -357, -363, -369, -374, -380, -386, -392, -398, -403, -409,
+  -415, -421, -426, -432, -438, -443, -449, -455, -460, -466,
+  -472, -477, -483, -488, -494, -499, -505, -510, -516, -521,
+  -526, -532, -537, -543, -548, -553, -558, -564, -569, -574,
+  -579, -584, -590, -595, -600, -605, -610, -615, -620, -625,
+  -630, -635, -640, -645, -650, -654, -659, -664, -669, -674,
+  -678, -683, -688, -692, -697, -702, -706, -711, -715, -720,
+  -724, -729, -733, -737, -742, -746, -750, -755, -759, -763,
+  -767, -771, -775, -779, -784, -788, -792, -796, -799, -803,
+  -807, -811, -815, -819, -822, -826, -830, -834, -837, -841,
+  -844, -848, -851, -855, -858, -862, -865, -868, -872, -875,
+  -878, -882, -885, -888, -891, -894, -897, -900, -903, -906,
+  -909, -912, -915, -917, -920, -923, -926, -928, -931, -934,
+  -936, -939, -941, -944, -946, -948, -951, -953, -955, -958,
+  -960, -962, -964, -966, -968, -970, -972, -974, -976, -978,
+  -980, -982, -983, -985, -987, -989, -990, -992, -993, -995,
+  -996, -998, -999, -1000, -1002, -1003, -1004, -1006, -1007, -1008,
+  -1009, -1010, -1011, -1012, -1013, -1014, -1015, -1016, -1016, -1017,
+  -1018, -1018, -1019, -1020, -1020, -1021, -1021, -1022, -1022, -1022,
+  -1023, -1023, -1023, -1024, -1024, -1024, -1024, -1024, -1024, -1024,
+  -1024, -1024, -1024, -1024, -1023, -1023, -1023, -1022, -1022, -1022,
+  -1021, -1021, -1020, -1020, -1019, -1018, -1018, -1017, -1016, -1016,
+  -1015, -1014, -1013, -1012, -1011, -1010, -1009, -1008, -1007, -1006,
+  -1004, -1003, -1002, -1000, -999, -998, -996, -995, -993, -992,
+  -990, -989, -987, -985, -983, -982, -980, -978, -976, -974,
+  -972, -970, -968, -966, -964, -962, -960, -958, -955, -953,
+  -951, -948, -946, -944, -941, -939, -936, -934, -931, -928,
+  -926, -923, -920, -917, -915, -912, -909, -906, -903, -900,
+  -897, -894, -891, -888, -885, -882, -878, -875, -872, -868,
+  -865, -862, -858, -855, -851, -848, -844, -841, -837, -834,
+  -830, -826, -822, -819, -815, -811, -807, -803, -799, -796,
+  -792, -788, -784, -779, -775, -771, -767, -763, -759, -755,
+  -750, -746, -742, -737, -733, -729, -724, -720, -715, -711,
+  -706, -702, -697, -692, -688, -683, -678, -674, -669, -664,
+  -659, -654, -650, -645, -640, -635, -630, -625, -620, -615,
+  -610, -605, -600, -595, -590, -584, -579, -574, -569, -564,
+  -558, -553, -548, -543, -537, -532, -526, -521, -516, -510,
+  -505, -499, -494, -488, -483, -477, -472, -466, -460, -455,
+  -449, -443, -438, -432, -426, -421, -415, -409, -403, -398,
+  -392, -386, -380, -374, -369, -363, -357, -351, -345, -339,
+  -333, -327, -321, -315, -309, -303, -297, -291, -285, -279,
+  -273, -267, -261, -255, -249, -243, -237, -230, -224, -218,
+  -212, -206, -200, -194, -187, -181, -175, -169, -163, -156,
+  -150, -144, -138, -132, -125, -119, -113, -107, -100, -94,
+  -88, -82, -75, -69, -63, -57, -50, -44, -38, -31,
+  -25, -19, -13, -6
 };
 
 
@@ -554,38 +957,144 @@ int char_vectors[37][5][4] = {
 
 int title(void);
 int game(void);
+int game_sim(void *data);
+void game_events(void);
+void set_input(int bits, int on);
+int take_input(void);
+void game_step(void);
+void game_render(void);
 void finish(void);
 void setup(int argc, char *argv[]);
 void seticon(void);
 int fast_cos(int v);
 int fast_sin(int v);
 void draw_line(int x1, int y1, color_type c1, int x2, int y2, color_type c2);
-int clip(int *x1, int *y1, int *x2, int *y2);
+void draw_line_on_screen(int x1, int y1, color_type c1,
+                         int x2, int y2, color_type c2);
+int wrap_offsets(int a, int b, int size, int *offsets);
+int cull_circle(int x, int y, int r);
+int clip(int x1, int y1, int x2, int y2, int *k0, int *k1);
+int clip_rows(int x1, int y1, int x2, int y2, int top, int bottom,
+              int *k0, int *k1);
+int floor_div(int a, int b);
 color_type mkcolor(int r, int g, int b);
 void sdl_drawline(int x1, int y1, color_type c1,
                   int x2, int y2, color_type c2);
-unsigned char encode(float x, float y);
-void drawvertline(int x, int y1, color_type c1, int y2, color_type c2);
+void record_line(int x1, int y1, color_type c1,
+                 int x2, int y2, color_type c2, int k0, int k1);
+void flush_draw_cmds(draw_list_type * list);
+void rasterize_list(draw_list_type * list);
+draw_cmd_type *new_draw_cmd(void);
+void grow_draw_list(draw_list_type * list, int n);
+void rasterize_cmd(draw_cmd_type * cmd, int top_row, int bottom_row);
+void reset_draw_lists(void);
+void publish_draw_list(void);
+int take_draw_list(void);
+int begin_layer(layer_type * layer, int k1, int k2, int k3, int k4);
+void end_layer(layer_type * layer);
+int draw_layer(draw_list_type * list);
+int near_layer(draw_list_type * list);
+int near_layer_lines(int x1, int y1, int x2, int y2);
+void upload_layer(void);
+int band_of_row(int y);
+int band_top(int band);
+void run_raster_job(int job);
+int raster_worker(void *data);
+void raster_band(int band);
+void start_raster_threads(void);
+void stop_raster_threads(void);
+void rasterize_line(int x1, int y1, color_type c1,
+                    int x2, int y2, color_type c2, int k, int k1,
+                    int top_row, int bottom_row);
+int line_steps(int x1, int y1, int x2, int y2);
+void drawvertline(int x, int y, int n, shade_type * sh);
+void drawhorizline(int x, int y, int n, shade_type * sh);
+void mkshade(shade_type * sh, color_type c1, color_type c2, int steps);
+void shade_advance(shade_type * sh, int steps);
+void drawline_run(int xa, int xb, int y, int x1, shade_type * sh);
+void span_fill(pixel_type * p, int n, int stride, pixel_type pixel);
+void span_shade(pixel_type * p, int n, int stride, shade_type * sh);
+void span_fill_index(Uint8 * p, int n, int stride, Uint8 index);
+void span_shade_index(Uint8 * p, int n, int stride, shade_type * sh);
 void putpixel(SDL_Surface * surface, int x, int y, Uint32 pixel);
+void span_putpixels(int x, int y, int n, int stepx, int stepy,
+                    shade_type * sh);
+void setup_screen_rows(void);
+void setup_index_screen(void);
+void build_palette(void);
+void expand_index_rect(SDL_Rect * r, SDL_Surface * bg);
+void expand_index_span(pixel_type * dst, Uint8 * src, pixel_type * bg,
+                       int n);
+void clear_coverage(void);
+void cover_vert(int x, int y, int n);
+void cover_row(int y, int lo, int hi);
+void cover_horiz(int x, int y, int n);
+void draw_shadows(void);
+void draw_shadow_rows(int top, int bottom);
+void shadow_row_mask(Uint32 * mask, Uint32 * above, Uint32 * row, int n);
+void setup_dirty_tiles(void);
+void mark_dirty_tiles(Uint32 * tiles);
+int dirty_tiles_to_rects(Uint32 * tiles);
+void erase_drawn_tiles(void);
+void upload_dirty_tiles(void);
+void draw_locked_bands(draw_list_type * list);
+void lock_screen(void);
+void unlock_screen(void);
+void setup_quads(void);
+void render_draw_cmds(draw_list_type * list);
+void quads_for_cmds(draw_list_type * list, int shadow);
+void quad_line(int x1, int y1, color_type c1, int x2, int y2, color_type c2,
+               int shadow);
+void quad_rect(int x, int y, int w, int h, color_type c, int shadow);
+void add_quad(float xa, float ya, float xb, float yb, float nx, float ny,
+              color_type ca, color_type cb, int shadow);
+void flush_quads(void);
 void draw_segment(int r1, int a1,
                   color_type c1,
                   int r2, int a2, color_type c2, int cx, int cy, int ang);
+void set_vertex(vertex_type * v, int r, int a, color_type c);
+void draw_polyline(vertex_type * v, int n, int closed,
+                   int cx, int cy, int a);
+void draw_polyline_at(int *xs, int *ys, color_type * cs, int n, int closed,
+                      int cx, int cy, int r);
 int add_bullet(int x, int y, int a, int xm, int ym);
 void add_asteroid(int x, int y, int xm, int ym, int size);
 void add_bit(int x, int y, int xm, int ym);
-void draw_asteroid(int size, int x, int y, int angle, shape_type * shape);
+void build_rock_verts(int i);
+void draw_asteroid(int i);
 void playsound(int snd);
 void hurt_asteroid(int j, int xm, int ym, int exp_size);
 void add_score(int amount);
 void draw_char(char c, int x, int y, int r, color_type cl);
+glyph_type *find_glyph(int v, int r);
+int glyph_stroke(int x1, int y1, int x2, int y2);
+int glyph_run(int xa, int ya, int xb, int yb);
+void record_glyph(int v, int r, int x, int y, color_type cl);
+void blit_glyph(draw_cmd_type * cmd, int top_row, int bottom_row);
 void draw_text(char *str, int x, int y, int s, color_type c);
 void draw_thick_line(int x1, int y1, color_type c1,
                      int x2, int y2, color_type c2);
+void build_sparkles(void);
+int sparkle_rand(void);
+void draw_sparkle(int v, int x, int y);
+void draw_sparkle_lines(sparkle_type * sp, int x, int y);
+void blit_sparkle(draw_cmd_type * cmd, int top_row, int bottom_row);
+void draw_bit(int x, int y, int xm, int ym, color_type c);
+void plot_bits(draw_cmd_type * cmd, int top_row, int bottom_row);
+void plot_bit_pixel(int x, int y, Uint32 pixel, int top_row, int bottom_row);
 void reset_level(void);
+void wrap_saved_state(void);
 void show_version(void);
 void show_usage(FILE * f, char *prg);
 void set_vid_mode(unsigned flags);
+void warp_mouse(int x, int y);
 void draw_centered_text(char *str, int y, int s, color_type c);
+void bench(void);
+double bench_render_secs(void);
+Uint64 bench_run(void);
+void bench_input(int counter, int *left, int *right, int *up, int *fire,
+                 int *shift);
+void bench_lap(int phase);
 
 
 /* --- MAIN --- */
@@ -601,6 +1110,17 @@ int main(int argc, char *argv[])
   setup(argc, argv);
 
 
+  /* Benchmark mode skips the title screen and saved state entirely: */
+
+  if (bench_frames > 0)
+  {
+    bench();
+    finish();
+
+    return (0);
+  }
+
+
   /* Set defaults: */
 
   score = 0;
@@ -660,6 +1180,8 @@ int main(int argc, char *argv[])
         sz = fread(asteroids, sizeof(asteroid_type), NUM_ASTEROIDS, fi);
         sz = fread(bits, sizeof(bit_type), NUM_BITS, fi);
         sz = sz;                /* FIXME */
+
+        wrap_saved_state();
       }
     }
 
@@ -725,13 +1247,16 @@ int title(void)
 {
   int done, quit, hover;
   int i, snapped, angle, size, counter, x, y, xm, ym, z1, z2, z3;
+  int show_last, show_layer;
   SDL_Event event;
   SDL_Keycode key;
   Uint32 now_time, last_time;
   char *titlestr = "VECTOROIDS";
   char str[64];
   letter_type letters[11];
+  vertex_type rock[12];
   color_type tmp_color;
+  SDL_Rect all;
 
 
   /* Reset letters: */
@@ -839,7 +1364,7 @@ int title(void)
               hover = 1;
           }
 
-          SDL_WarpMouseInWindow(window, WIDTH / 2, 187 + (hover - 1) * 15);
+          warp_mouse(WIDTH / 2, 187 + (hover - 1) * 15);
         }
         else if (key == SDLK_ESCAPE)
         {
@@ -946,8 +1471,12 @@ int title(void)
 
     /* (Erase first) */
 
-    SDL_FillRect(screen, NULL, SDL_MapRGB(screen->format, 0, 0, 0));
-    memset(drawn_at, 0, sizeof(Uint8) * (HEIGHT + 1) * (WIDTH + 1));
+    if (use_indexed)
+      SDL_FillRect(index_screen, NULL, 0);
+    else
+      SDL_FillRect(screen, NULL, SDL_MapRGB(screen->format, 0, 0, 0));
+
+    clear_coverage();
 
 
     /* (Title) */
@@ -974,33 +1503,41 @@ int title(void)
     }
 
 
-    /* (Credits) */
+    /* (Credits; kept from frame to frame, unless the scores have changed,
+       or the last score has blinked) */
 
     if (snapped == strlen(titlestr))
     {
-      draw_centered_text("BY BILL KENDRICK", 140, 5, mkcolor(128, 128, 128));
-      draw_centered_text("NEW BREED SOFTWARE", 155, 5, mkcolor(96, 96, 96));
+      show_last = (score != 0 && (score != high || (counter % 20) < 10));
+
+      if (begin_layer(&title_layer, high, score, game_pending, show_last))
+      {
+        draw_centered_text("BY BILL KENDRICK", 140, 5, mkcolor(128, 128, 128));
+        draw_centered_text("NEW BREED SOFTWARE", 155, 5, mkcolor(96, 96, 96));
 
 #ifndef EMBEDDED
-      snprintf(str, sizeof(str), "VERSION %s   %s", VER_VERSION, VER_DATE);
+        snprintf(str, sizeof(str), "VERSION %s   %s", VER_VERSION, VER_DATE);
 #else
-      snprintf(str, sizeof(str), "VER %s  %s", VER_VERSION, VER_DATE);
+        snprintf(str, sizeof(str), "VER %s  %s", VER_VERSION, VER_DATE);
 #endif
-      draw_centered_text(str, (HEIGHT - 20), 5, mkcolor(96, 96, 96));
+        draw_centered_text(str, (HEIGHT - 20), 5, mkcolor(96, 96, 96));
 
-      snprintf(str, sizeof(str), "HIGH %.6d", high);
-      draw_text(str, (WIDTH - 110) / 2, 5, 5, mkcolor(128, 255, 255));
-      draw_text(str, (WIDTH - 110) / 2 + 1, 6, 5, mkcolor(128, 255, 255));
+        snprintf(str, sizeof(str), "HIGH %.6d", high);
+        draw_text(str, (WIDTH - 110) / 2, 5, 5, mkcolor(128, 255, 255));
+        draw_text(str, (WIDTH - 110) / 2 + 1, 6, 5, mkcolor(128, 255, 255));
 
-      if (score != 0 && (score != high || (counter % 20) < 10))
-      {
-        if (game_pending == 0)
-          snprintf(str, sizeof(str), "LAST %.6d", score);
-        else
-          snprintf(str, sizeof(str), "SCR  %.6d", score);
-        draw_text(str, (WIDTH - 110) / 2, 25, 5, mkcolor(128, 128, 255));
-        draw_text(str, (WIDTH - 110) / 2 + 1, 26, 5, mkcolor(128, 128, 255));
+        if (show_last)
+        {
+          if (game_pending == 0)
+            snprintf(str, sizeof(str), "LAST %.6d", score);
+          else
+            snprintf(str, sizeof(str), "SCR  %.6d", score);
+          draw_text(str, (WIDTH - 110) / 2, 25, 5, mkcolor(128, 128, 255));
+          draw_text(str, (WIDTH - 110) / 2 + 1, 26, 5, mkcolor(128, 128, 255));
+        }
       }
+
+      end_layer(&title_layer);
     }
 
 
@@ -1028,39 +1565,52 @@ int title(void)
 
     /* (Giant rock) */
 
-    draw_segment(40 / size, 0, mkcolor(255, 255, 255),
-                 30 / size, 30, mkcolor(255, 255, 255), x, y, angle);
-    draw_segment(30 / size, 30, mkcolor(255, 255, 255),
-                 40 / size, 55, mkcolor(255, 255, 255), x, y, angle);
-    draw_segment(40 / size, 55, mkcolor(255, 255, 255),
-                 25 / size, 90, mkcolor(255, 255, 255), x, y, angle);
-    draw_segment(25 / size, 90, mkcolor(255, 255, 255),
-                 40 / size, 120, mkcolor(255, 255, 255), x, y, angle);
-    draw_segment(40 / size, 120, mkcolor(255, 255, 255),
-                 35 / size, 130, mkcolor(255, 255, 255), x, y, angle);
-    draw_segment(35 / size, 130, mkcolor(255, 255, 255),
-                 40 / size, 160, mkcolor(255, 255, 255), x, y, angle);
-    draw_segment(40 / size, 160, mkcolor(255, 255, 255),
-                 30 / size, 200, mkcolor(255, 255, 255), x, y, angle);
-    draw_segment(30 / size, 200, mkcolor(255, 255, 255),
-                 45 / size, 220, mkcolor(255, 255, 255), x, y, angle);
-    draw_segment(45 / size, 220, mkcolor(255, 255, 255),
-                 25 / size, 265, mkcolor(255, 255, 255), x, y, angle);
-    draw_segment(25 / size, 265, mkcolor(255, 255, 255),
-                 30 / size, 300, mkcolor(255, 255, 255), x, y, angle);
-    draw_segment(30 / size, 300, mkcolor(255, 255, 255),
-                 45 / size, 335, mkcolor(255, 255, 255), x, y, angle);
-    draw_segment(45 / size, 335, mkcolor(255, 255, 255),
-                 40 / size, 0, mkcolor(255, 255, 255), x, y, angle);
+    for (i = 0; i < 12; i++)
+    {
+      set_vertex(&rock[i], title_rock[i].radius / size, title_rock[i].angle,
+                 mkcolor(255, 255, 255));
+    }
+
+    draw_polyline(rock, 12, TRUE, x, y, angle);
 
 
     /* Flush and pause! */
 
-    /* SDL_Flip(screen); *//* SDL1.2 method */
-    SDL_UpdateTexture(screenTexture, NULL, screen->pixels, screen->pitch);
-    SDL_RenderClear(renderer);
-    SDL_RenderCopy(renderer, bkgdTexture, NULL, NULL);
-    SDL_RenderCopy(renderer, screenTexture, NULL, NULL);
+    show_layer = draw_layer(record_list);
+
+    if (use_sdl_renderer)
+    {
+      SDL_RenderClear(renderer);
+      render_draw_cmds(record_list);
+    }
+    else
+    {
+      flush_draw_cmds(record_list);
+      draw_shadows();
+
+      /* SDL_Flip(screen); *//* SDL1.2 method */
+      if (use_indexed)
+      {
+        all.x = 0;
+        all.y = 0;
+        all.w = WIDTH;
+        all.h = HEIGHT;
+
+        expand_index_rect(&all, NULL);
+      }
+      else
+      {
+        SDL_UpdateTexture(screenTexture, NULL, screen->pixels,
+                          screen->pitch);
+      }
+
+      SDL_RenderClear(renderer);
+      SDL_RenderCopy(renderer, screenTexture, NULL, NULL);
+    }
+
+    if (show_layer)
+      SDL_RenderCopy(renderer, layerTexture, &layer_rect, &layer_rect);
+
     SDL_RenderPresent(renderer);
 
     now_time = SDL_GetTicks();
@@ -1072,7 +1622,7 @@ int title(void)
   }
   while (!done);
 
-  SDL_WarpMouseInWindow(window, WIDTH - 5, HEIGHT - 5);
+  warp_mouse(WIDTH - 5, HEIGHT - 5);
 
   return (quit);
 }
@@ -1092,6 +1642,18 @@ int title(void)
 #define TAP_H_RGT (WIDTH * 2 / 3)
 #define TAP_H_FARRGT (WIDTH - 1)
 
+
+/* Controls, as handed from events to the simulation (see take_input()): */
+
+#define INPUT_LEFT 0x01
+#define INPUT_RIGHT 0x02
+#define INPUT_UP 0x04
+#define INPUT_FIRE 0x08
+#define INPUT_SHIFT 0x10
+#define INPUT_FIRE_RELEASED 0x20
+#define INPUT_TAPPED 0x40
+#define INPUT_ONE_SHOT (INPUT_FIRE_RELEASED | INPUT_TAPPED)
+
 void handle_click_tap_controls(int x, int y, int *lft, int *rgt, int *up,
                                int *fire)
 {
@@ -1120,28 +1682,14 @@ void handle_click_tap_controls(int x, int y, int *lft, int *rgt, int *up,
 
 int game(void)
 {
-  int done, quit, counter;
-  int i, j;
-  int num_asteroids_alive;
-  SDL_Event event;
-  SDL_Keycode key;
-  int left_pressed, right_pressed, up_pressed, shift_pressed;
-  int fire_pressed, firing;
-  char str[32];
-  Uint32 now_time, last_time;
-  color_type tmp_color;
-  int tap_area_brightness;
-
+  int i;
+  SDL_Thread *sim_thread;
 
-  done = 0;
-  quit = 0;
-  counter = 0;
 
-  left_pressed = 0;
-  right_pressed = 0;
-  up_pressed = 0;
-  shift_pressed = 0;
-  fire_pressed = 0;
+  SDL_AtomicSet(&game_done, 0);
+  SDL_AtomicSet(&game_input, 0);
+  game_quit = 0;
+  game_counter = 0;
   firing = 0;
   tap_area_brightness = 0;
 
@@ -1163,6 +1711,14 @@ int game(void)
   }
 
   game_pending = 1;
+  reset_draw_lists();
+  sparkle_seed = rand() | 1;
+
+
+  /* (The title screen's been on "screen"; start by redoing all of it) */
+
+  for (i = 0; i < NUM_DIRTY_BANDS; i++)
+    drawn_tiles[i] = DIRTY_ALL;
 
 
   /* Hide mouse cursor: */
@@ -1182,593 +1738,767 @@ int game(void)
 #endif
 
 
-  do
+  if (bench_frames == 0)
   {
-    last_time = SDL_GetTicks();
-    counter++;
+    /* Simulate on a thread of its own, at a steady FPS, while this one
+       handles events and draws each frame the simulation publishes: */
 
+    sim_thread = SDL_CreateThread(game_sim, "simulation", NULL);
 
-    /* Handle events: */
+    if (sim_thread == NULL)
+    {
+      fprintf(stderr,
+              "\nError: I could not start the simulation thread!\n"
+              "The Simple DirectMedia error that occured was:\n"
+              "%s\n\n", SDL_GetError());
+      exit(1);
+    }
 
-    while (SDL_PollEvent(&event) > 0)
+    do
     {
-      if (event.type == SDL_QUIT)
-      {
-        /* Quit! */
+      game_events();
 
-        done = 1;
-        quit = 1;
-      }
-      else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)
-      {
-        key = event.key.keysym.sym;
+      if (take_draw_list())
+        game_render();
+      else
+        SDL_Delay(1);
+    }
+    while (!SDL_AtomicGet(&game_done));
 
-        if (event.type == SDL_KEYDOWN)
-        {
-          if (key == SDLK_ESCAPE)
-          {
-            /* Return to menu! */
+    SDL_WaitThread(sim_thread, NULL);
+  }
+  else
+  {
+    /* Benchmark: simulate and draw in lock-step, with no frame delay,
+       so each phase of each frame can be timed: */
 
-            done = 1;
-          }
+    do
+    {
+      game_events();
+      game_step();
+      publish_draw_list();
+      take_draw_list();
+      game_render();
+    }
+    while (!SDL_AtomicGet(&game_done));
+  }
 
 
-          /* Key press... */
+  /* Record, if a high score: */
 
-          if (key == SDLK_RIGHT)
-          {
-            /* Rotate CW */
+  if (score >= high)
+  {
+    high = score;
+  }
 
-            left_pressed = 0;
-            right_pressed = 1;
-          }
-          else if (key == SDLK_LEFT)
-          {
-            /* Rotate CCW */
 
-            left_pressed = 1;
-            right_pressed = 0;
-          }
-          else if (key == SDLK_UP)
-          {
-            /* Thrust! */
+  /* Display mouse cursor: */
 
-            up_pressed = 1;
-          }
-          else if (key == SDLK_SPACE)
-          {
-            /* Fire a bullet! */
+  if (fullscreen)
+    SDL_ShowCursor(1);
 
-            fire_pressed = 1;
-          }
 
-          if (key == SDLK_LSHIFT || key == SDLK_RSHIFT)
-          {
-            /* Respawn now (if applicable) */
+  return (game_quit);
+}
 
-            shift_pressed = 1;
-          }
-        }
-        else if (event.type == SDL_KEYUP)
-        {
-          /* Key release... */
 
-          if (key == SDLK_RIGHT)
-          {
-            right_pressed = 0;
-          }
-          else if (key == SDLK_LEFT)
-          {
-            left_pressed = 0;
-          }
-          else if (key == SDLK_UP)
-          {
-            up_pressed = 0;
-          }
-          else if (key == SDLK_SPACE)
-          {
-            fire_pressed = 0;
-            firing = 0;
-          }
+/* The simulation thread: step the game at FPS frames per second, handing
+   each frame to the renderer as soon as it's recorded: */
 
-          if (key == SDLK_LSHIFT || key == SDLK_RSHIFT)
-          {
-            /* Respawn now (if applicable) */
+int game_sim(void *data)
+{
+  Uint32 now_time, next_time;
 
-            shift_pressed = 0;
-          }
-        }
-      }
-#ifdef JOY_YES
-      else if (event.type == SDL_JOYBUTTONDOWN && player_alive)
+
+  (void) data;
+
+  next_time = SDL_GetTicks();
+
+  do
+  {
+    game_step();
+    publish_draw_list();
+
+
+    /* Pause until the next frame is due (or, if we've fallen behind, go
+       on at once, without trying to catch up): */
+
+    next_time = next_time + 1000 / FPS;
+    now_time = SDL_GetTicks();
+
+    if (now_time < next_time)
+      SDL_Delay(next_time - now_time);
+    else
+      next_time = now_time;
+  }
+  while (!SDL_AtomicGet(&game_done));
+
+  return (0);
+}
+
+
+/* Handle events, passing controls on to the simulation (see take_input()): */
+
+void game_events(void)
+{
+  SDL_Event event;
+  SDL_Keycode key;
+  int left_pressed, right_pressed, up_pressed, fire_pressed;
+
+
+  while (SDL_PollEvent(&event) > 0)
+  {
+    if (event.type == SDL_QUIT)
+    {
+      /* Quit! */
+
+      game_quit = 1;
+      SDL_AtomicSet(&game_done, 1);
+    }
+    else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)
+    {
+      key = event.key.keysym.sym;
+
+      if (event.type == SDL_KEYDOWN)
       {
-        if (event.jbutton.button == JOY_B)
+        if (key == SDLK_ESCAPE)
         {
-          /* Fire a bullet! */
+          /* Return to menu! */
 
-          fire_pressed = 1;
+          SDL_AtomicSet(&game_done, 1);
         }
-        else if (event.jbutton.button == JOY_A)
+
+
+        /* Key press... */
+
+        if (key == SDLK_RIGHT)
         {
-          /* Thrust: */
+          /* Rotate CW */
 
-          up_pressed = 1;
+          set_input(INPUT_LEFT, 0);
+          set_input(INPUT_RIGHT, 1);
         }
-        else
+        else if (key == SDLK_LEFT)
         {
-          shift_pressed = 1;
+          /* Rotate CCW */
+
+          set_input(INPUT_LEFT, 1);
+          set_input(INPUT_RIGHT, 0);
         }
-      }
-      else if (event.type == SDL_JOYBUTTONUP)
-      {
-        if (event.jbutton.button == JOY_B)
+        else if (key == SDLK_UP)
         {
-          /* Release firebutton: */
+          /* Thrust! */
 
-          fire_pressed = 0;
-          firing = 0;
+          set_input(INPUT_UP, 1);
         }
-        else if (event.jbutton.button == JOY_A)
+        else if (key == SDLK_SPACE)
         {
-          /* Stop thrust: */
+          /* Fire a bullet! */
 
-          up_pressed = 0;
+          set_input(INPUT_FIRE, 1);
         }
-        else if (event.jbutton.button != JOY_B)
+
+        if (key == SDLK_LSHIFT || key == SDLK_RSHIFT)
         {
-          /* Any other button: respawn */
+          /* Respawn now (if applicable) */
 
-          shift_pressed = 0;
+          set_input(INPUT_SHIFT, 1);
         }
       }
-      else if (event.type == SDL_JOYAXISMOTION)
+      else if (event.type == SDL_KEYUP)
       {
-        if (event.jaxis.axis == JOY_X)
+        /* Key release... */
+
+        if (key == SDLK_RIGHT)
         {
-          if (event.jaxis.value < -256)
-          {
-            left_pressed = 1;
-            right_pressed = 0;
-          }
-          else if (event.jaxis.value > 256)
-          {
-            left_pressed = 0;
-            right_pressed = 1;
-          }
-          else
-          {
-            left_pressed = 0;
-            right_pressed = 0;
-          }
+          set_input(INPUT_RIGHT, 0);
+        }
+        else if (key == SDLK_LEFT)
+        {
+          set_input(INPUT_LEFT, 0);
+        }
+        else if (key == SDLK_UP)
+        {
+          set_input(INPUT_UP, 0);
+        }
+        else if (key == SDLK_SPACE)
+        {
+          set_input(INPUT_FIRE, 0);
+          set_input(INPUT_FIRE_RELEASED, 1);
+        }
+
+        if (key == SDLK_LSHIFT || key == SDLK_RSHIFT)
+        {
+          /* Respawn now (if applicable) */
+
+          set_input(INPUT_SHIFT, 0);
         }
       }
-#endif
-      else if (event.type == SDL_MOUSEMOTION)
-      {
-        tap_area_brightness = 255;
-
-        if (SDL_GetMouseState(NULL, NULL) != 0)
-          handle_click_tap_controls(event.motion.x, event.motion.y,
-                                    &left_pressed, &right_pressed,
-                                    &up_pressed, &fire_pressed);
-      }
-      else if (event.type == SDL_MOUSEBUTTONDOWN)
+    }
+#ifdef JOY_YES
+    else if (event.type == SDL_JOYBUTTONDOWN)
+    {
+      if (event.jbutton.button == JOY_B)
+      {
+        /* Fire a bullet! */
+
+        set_input(INPUT_FIRE, 1);
+      }
+      else if (event.jbutton.button == JOY_A)
       {
-        tap_area_brightness = 255;
+        /* Thrust: */
 
-        handle_click_tap_controls(event.button.x, event.button.y,
-                                  &left_pressed, &right_pressed, &up_pressed,
-                                  &fire_pressed);
+        set_input(INPUT_UP, 1);
       }
-      else if (event.type == SDL_MOUSEBUTTONUP)
+      else
       {
-        left_pressed = 0;
-        right_pressed = 0;
-        up_pressed = 0;
-        fire_pressed = 0;
-        firing = 0;
+        set_input(INPUT_SHIFT, 1);
       }
     }
+    else if (event.type == SDL_JOYBUTTONUP)
+    {
+      if (event.jbutton.button == JOY_B)
+      {
+        /* Release firebutton: */
 
+        set_input(INPUT_FIRE, 0);
+        set_input(INPUT_FIRE_RELEASED, 1);
+      }
+      else if (event.jbutton.button == JOY_A)
+      {
+        /* Stop thrust: */
 
-    /* Rotate ship: */
+        set_input(INPUT_UP, 0);
+      }
+      else if (event.jbutton.button != JOY_B)
+      {
+        /* Any other button: respawn */
 
-    if (right_pressed)
-    {
-      angle = angle - 8;
-      if (angle < 0)
-        angle = angle + 360;
+        set_input(INPUT_SHIFT, 0);
+      }
     }
-    else if (left_pressed)
+    else if (event.type == SDL_JOYAXISMOTION)
     {
-      angle = angle + 8;
-      if (angle >= 360)
-        angle = angle - 360;
+      if (event.jaxis.axis == JOY_X)
+      {
+        set_input(INPUT_LEFT, event.jaxis.value < -256);
+        set_input(INPUT_RIGHT, event.jaxis.value > 256);
+      }
     }
-
-    /* Fire bullets */
-    if (fire_pressed && player_alive)
+#endif
+    else if (event.type == SDL_MOUSEMOTION ||
+             event.type == SDL_MOUSEBUTTONDOWN)
     {
-      if (!firing)
+      set_input(INPUT_TAPPED, 1);
+
+      if (event.type == SDL_MOUSEBUTTONDOWN ||
+          SDL_GetMouseState(NULL, NULL) != 0)
       {
-        firing = add_bullet(x >> 4, y >> 4, angle, xm, ym);
+        if (event.type == SDL_MOUSEMOTION)
+          handle_click_tap_controls(event.motion.x, event.motion.y,
+                                    &left_pressed, &right_pressed,
+                                    &up_pressed, &fire_pressed);
+        else
+          handle_click_tap_controls(event.button.x, event.button.y,
+                                    &left_pressed, &right_pressed,
+                                    &up_pressed, &fire_pressed);
+
+        set_input(INPUT_LEFT, left_pressed);
+        set_input(INPUT_RIGHT, right_pressed);
+        set_input(INPUT_UP, up_pressed);
+        set_input(INPUT_FIRE, fire_pressed);
       }
     }
+    else if (event.type == SDL_MOUSEBUTTONUP)
+    {
+      set_input(INPUT_LEFT | INPUT_RIGHT | INPUT_UP | INPUT_FIRE, 0);
+      set_input(INPUT_FIRE_RELEASED, 1);
+    }
+  }
+
+  bench_lap(BENCH_EVENTS);
+}
+
+
+/* Set (or clear) controls for the simulation to pick up: */
+
+void set_input(int bits, int on)
+{
+  int old;
+
+  do
+  {
+    old = SDL_AtomicGet(&game_input);
+  }
+  while (!SDL_AtomicCAS(&game_input, old,
+                        (on ? (old | bits) : (old & ~bits))));
+}
+
+
+/* Pick up the controls (clearing the one-shot ones, like a released fire
+   button, which are only to be seen once): */
+
+int take_input(void)
+{
+  int old;
+
+  do
+  {
+    old = SDL_AtomicGet(&game_input);
+  }
+  while (!SDL_AtomicCAS(&game_input, old, old & ~INPUT_ONE_SHOT));
+
+  return (old);
+}
+
+
+/* Advance the game one frame, and record what it looks like: */
+
+void game_step(void)
+{
+  int i, j, input;
+  int num_asteroids_alive;
+  int left_pressed, right_pressed, up_pressed, shift_pressed;
+  int fire_pressed;
+  char str[32];
+  vertex_type ship[5];
+  color_type tmp_color;
+
+
+  game_counter++;
+
+  input = take_input();
+
+  left_pressed = ((input & INPUT_LEFT) != 0);
+  right_pressed = ((input & INPUT_RIGHT) != 0);
+  up_pressed = ((input & INPUT_UP) != 0);
+  fire_pressed = ((input & INPUT_FIRE) != 0);
+  shift_pressed = ((input & INPUT_SHIFT) != 0);
+
+  if (input & INPUT_FIRE_RELEASED)
+    firing = 0;
+
+  if (input & INPUT_TAPPED)
+    tap_area_brightness = 255;
+
+  if (bench_frames > 0)
+  {
+    /* Benchmark: fly a canned pattern instead of reading input: */
+
+    bench_input(game_counter, &left_pressed, &right_pressed, &up_pressed,
+                &fire_pressed, &shift_pressed);
+
+    if (!fire_pressed)
+      firing = 0;
+
+    bench_frames_done++;
+    if (bench_frames_done >= bench_frames)
+      SDL_AtomicSet(&game_done, 1);
+  }
+
+  bench_lap(BENCH_EVENTS);
+
+
+  /* Rotate ship: */
 
-    /* Thrust ship: */
+  if (right_pressed)
+  {
+    angle = angle - 8;
+    if (angle < 0)
+      angle = angle + 360;
+  }
+  else if (left_pressed)
+  {
+    angle = angle + 8;
+    if (angle >= 360)
+      angle = angle - 360;
+  }
 
-    if (up_pressed && player_alive)
+  /* Fire bullets */
+  if (fire_pressed && player_alive)
+  {
+    if (!firing)
     {
-      /* Move forward: */
+      firing = add_bullet(x >> 4, y >> 4, angle, xm, ym);
+    }
+  }
+
+  /* Thrust ship: */
 
-      xm = xm + ((fast_cos(angle >> 3) * 3) >> 10);
-      ym = ym - ((fast_sin(angle >> 3) * 3) >> 10);
+  if (up_pressed && player_alive)
+  {
+    /* Move forward: */
+
+    xm = xm + ((fast_cos(angle) * 3) >> 10);
+    ym = ym - ((fast_sin(angle) * 3) >> 10);
 
 
-      /* Start thruster sound: */
+    /* Start thruster sound: */
 #ifndef NOSOUND
-      if (use_sound)
+    if (use_sound)
+    {
+      if (!Mix_Playing(CHAN_THRUST))
       {
-        if (!Mix_Playing(CHAN_THRUST))
-        {
 #ifndef EMBEDDED
-          Mix_PlayChannel(CHAN_THRUST, sounds[SND_THRUST], -1);
+        Mix_PlayChannel(CHAN_THRUST, sounds[SND_THRUST], -1);
 #else
-          Mix_PlayChannel(-1, sounds[SND_THRUST], 0);
+        Mix_PlayChannel(-1, sounds[SND_THRUST], 0);
 #endif
-        }
       }
-#endif
     }
-    else
-    {
-      /* Slow down (unrealistic, but.. feh!) */
+#endif
+  }
+  else
+  {
+    /* Slow down (unrealistic, but.. feh!) */
 
-      if ((counter % 20) == 0)
-      {
-        xm = (xm * 7) / 8;
-        ym = (ym * 7) / 8;
-      }
+    if ((game_counter % 20) == 0)
+    {
+      xm = (xm * 7) / 8;
+      ym = (ym * 7) / 8;
+    }
 
 
-      /* Stop thruster sound: */
+    /* Stop thruster sound: */
 
 #ifndef NOSOUND
-      if (use_sound)
+    if (use_sound)
+    {
+      if (Mix_Playing(CHAN_THRUST))
       {
-        if (Mix_Playing(CHAN_THRUST))
-        {
 #ifndef EMBEDDED
-          Mix_HaltChannel(CHAN_THRUST);
+        Mix_HaltChannel(CHAN_THRUST);
 #endif
-        }
       }
-#endif
     }
+#endif
+  }
 
 
-    /* Handle player death: */
+  /* Handle player death: */
 
-    if (player_alive == 0)
-    {
-      player_die_timer--;
+  if (player_alive == 0)
+  {
+    player_die_timer--;
 
-      if (player_die_timer <= 0)
+    if (player_die_timer <= 0)
+    {
+      if (lives > 0)
       {
-        if (lives > 0)
-        {
-          /* Reset player: */
+        /* Reset player: */
 
-          player_die_timer = 0;
-          angle = 90;
-          x = (WIDTH / 2) << 4;
-          y = (HEIGHT / 2) << 4;
-          xm = 0;
-          ym = 0;
+        player_die_timer = 0;
+        angle = 90;
+        x = (WIDTH / 2) << 4;
+        y = (HEIGHT / 2) << 4;
+        xm = 0;
+        ym = 0;
 
 
-          /* Only bring player back when it's alright to! */
+        /* Only bring player back when it's alright to! */
 
-          player_alive = 1;
+        player_alive = 1;
 
-          if (!shift_pressed)
+        if (!shift_pressed)
+        {
+          for (i = 0; i < NUM_ASTEROIDS && player_alive; i++)
           {
-            for (i = 0; i < NUM_ASTEROIDS && player_alive; i++)
+            if (asteroids[i].alive)
             {
-              if (asteroids[i].alive)
+              if (asteroids[i].x >= (x >> 4) - (WIDTH / 5) &&
+                  asteroids[i].x <= (x >> 4) + (WIDTH / 5) &&
+                  asteroids[i].y >= (y >> 4) - (HEIGHT / 5) &&
+                  asteroids[i].y <= (y >> 4) + (HEIGHT / 5))
               {
-                if (asteroids[i].x >= (x >> 4) - (WIDTH / 5) &&
-                    asteroids[i].x <= (x >> 4) + (WIDTH / 5) &&
-                    asteroids[i].y >= (y >> 4) - (HEIGHT / 5) &&
-                    asteroids[i].y <= (y >> 4) + (HEIGHT / 5))
-                {
-                  /* If any asteroid is too close for comfort,
-                     don't bring ship back yet! */
-
-                  player_alive = 0;
-                }
+                /* If any asteroid is too close for comfort,
+                   don't bring ship back yet! */
+
+                player_alive = 0;
               }
             }
           }
         }
-        else
-        {
-          done = 1;
-          game_pending = 0;
-        }
+      }
+      else
+      {
+        SDL_AtomicSet(&game_done, 1);
+        game_pending = 0;
       }
     }
+  }
 
 
-    /* Erase screen: */
-
-    SDL_BlitSurface(bkgd, NULL, screen, NULL);
-    memset(drawn_at, 0, sizeof(Uint8) * (HEIGHT + 1) * (WIDTH + 1));
-
-
-    /* Draw click/tap-based control area */
-    if (tap_area_brightness >= 128)
-    {
-      tmp_color =
-        mkcolor(tap_area_brightness >> 1, tap_area_brightness >> 1,
-                tap_area_brightness);
-
-      draw_line(TAP_H_LFT, TAP_V_TOP, tmp_color, TAP_H_RGT, TAP_V_TOP,
-                tmp_color);
-      draw_line(TAP_H_FARLFT, TAP_V_MID, tmp_color, TAP_H_FARRGT, TAP_V_MID,
-                tmp_color);
-      draw_line(TAP_H_FARLFT, TAP_V_BOT, tmp_color, TAP_H_FARRGT, TAP_V_BOT,
-                tmp_color);
-
-      draw_line(TAP_H_LFT, TAP_V_TOP, tmp_color, TAP_H_LFT, TAP_V_MID,
-                tmp_color);
-      draw_line(TAP_H_RGT, TAP_V_TOP, tmp_color, TAP_H_RGT, TAP_V_MID,
-                tmp_color);
+  bench_lap(BENCH_SIM);
 
-      draw_line(TAP_H_CTR, TAP_V_MID, tmp_color, TAP_H_CTR, TAP_V_BOT,
-                tmp_color);
 
-      draw_line(TAP_H_LFT, TAP_V_BOT, tmp_color, TAP_H_LFT, TAP_V_FARBOT,
-                tmp_color);
-      draw_line(TAP_H_RGT, TAP_V_BOT, tmp_color, TAP_H_RGT, TAP_V_FARBOT,
-                tmp_color);
+  /* Draw click/tap-based control area */
+  if (tap_area_brightness >= 128)
+  {
+    tmp_color =
+      mkcolor(tap_area_brightness >> 1, tap_area_brightness >> 1,
+              tap_area_brightness);
+
+    draw_line(TAP_H_LFT, TAP_V_TOP, tmp_color, TAP_H_RGT, TAP_V_TOP,
+              tmp_color);
+    draw_line(TAP_H_FARLFT, TAP_V_MID, tmp_color, TAP_H_FARRGT, TAP_V_MID,
+              tmp_color);
+    draw_line(TAP_H_FARLFT, TAP_V_BOT, tmp_color, TAP_H_FARRGT, TAP_V_BOT,
+              tmp_color);
+
+    draw_line(TAP_H_LFT, TAP_V_TOP, tmp_color, TAP_H_LFT, TAP_V_MID,
+              tmp_color);
+    draw_line(TAP_H_RGT, TAP_V_TOP, tmp_color, TAP_H_RGT, TAP_V_MID,
+              tmp_color);
+
+    draw_line(TAP_H_CTR, TAP_V_MID, tmp_color, TAP_H_CTR, TAP_V_BOT,
+              tmp_color);
+
+    draw_line(TAP_H_LFT, TAP_V_BOT, tmp_color, TAP_H_LFT, TAP_V_FARBOT,
+              tmp_color);
+    draw_line(TAP_H_RGT, TAP_V_BOT, tmp_color, TAP_H_RGT, TAP_V_FARBOT,
+              tmp_color);
+
+    /* It fades out if you're not using it */
+    tap_area_brightness--;
+  }
 
-      /* It fades out if you're not using it */
-      tap_area_brightness--;
-    }
+  bench_lap(BENCH_RECORD);
 
-    /* Move ship: */
+  /* Move ship: */
 
-    x = x + xm;
-    y = y + ym;
+  x = x + xm;
+  y = y + ym;
 
 
-    /* Wrap ship around edges of screen: */
+  /* Wrap ship around edges of screen: */
 
-    if (x >= (WIDTH << 4))
-      x = x - (WIDTH << 4);
-    else if (x < 0)
-      x = x + (WIDTH << 4);
+  if (x >= (WIDTH << 4))
+    x = x - (WIDTH << 4);
+  else if (x < 0)
+    x = x + (WIDTH << 4);
 
-    if (y >= (HEIGHT << 4))
-      y = y - (HEIGHT << 4);
-    else if (y < 0)
-      y = y + (HEIGHT << 4);
+  if (y >= (HEIGHT << 4))
+    y = y - (HEIGHT << 4);
+  else if (y < 0)
+    y = y + (HEIGHT << 4);
 
 
-    /* Move bullets: */
+  /* Move bullets: */
 
-    for (i = 0; i < NUM_BULLETS; i++)
+  for (i = 0; i < NUM_BULLETS; i++)
+  {
+    if (bullets[i].timer >= 0)
     {
-      if (bullets[i].timer >= 0)
-      {
-        /* Bullet wears out: */
+      /* Bullet wears out: */
 
-        bullets[i].timer--;
+      bullets[i].timer--;
 
 
-        /* Move bullet: */
+      /* Move bullet: */
 
-        bullets[i].x = bullets[i].x + bullets[i].xm;
-        bullets[i].y = bullets[i].y + bullets[i].ym;
+      bullets[i].x = bullets[i].x + bullets[i].xm;
+      bullets[i].y = bullets[i].y + bullets[i].ym;
 
 
-        /* Wrap bullet around edges of screen: */
+      /* Wrap bullet around edges of screen: */
 
-        if (bullets[i].x >= WIDTH)
-          bullets[i].x = bullets[i].x - WIDTH;
-        else if (bullets[i].x < 0)
-          bullets[i].x = bullets[i].x + WIDTH;
+      if (bullets[i].x >= WIDTH)
+        bullets[i].x = bullets[i].x - WIDTH;
+      else if (bullets[i].x < 0)
+        bullets[i].x = bullets[i].x + WIDTH;
 
-        if (bullets[i].y >= HEIGHT)
-          bullets[i].y = bullets[i].y - HEIGHT;
-        else if (bullets[i].y < 0)
-          bullets[i].y = bullets[i].y + HEIGHT;
+      if (bullets[i].y >= HEIGHT)
+        bullets[i].y = bullets[i].y - HEIGHT;
+      else if (bullets[i].y < 0)
+        bullets[i].y = bullets[i].y + HEIGHT;
 
 
-        /* Check for collision with any asteroids! */
+      /* Check for collision with any asteroids! */
 
-        for (j = 0; j < NUM_ASTEROIDS; j++)
+      for (j = 0; j < NUM_ASTEROIDS; j++)
+      {
+        if (bullets[i].timer > 0 && asteroids[j].alive)
         {
-          if (bullets[i].timer > 0 && asteroids[j].alive)
+          if ((bullets[i].x + 5 >=
+               asteroids[j].x - asteroids[j].size * AST_RADIUS) &&
+              (bullets[i].x - 5 <=
+               asteroids[j].x + asteroids[j].size * AST_RADIUS) &&
+              (bullets[i].y + 5 >=
+               asteroids[j].y - asteroids[j].size * AST_RADIUS) &&
+              (bullets[i].y - 5 <=
+               asteroids[j].y + asteroids[j].size * AST_RADIUS))
           {
-            if ((bullets[i].x + 5 >=
-                 asteroids[j].x - asteroids[j].size * AST_RADIUS) &&
-                (bullets[i].x - 5 <=
-                 asteroids[j].x + asteroids[j].size * AST_RADIUS) &&
-                (bullets[i].y + 5 >=
-                 asteroids[j].y - asteroids[j].size * AST_RADIUS) &&
-                (bullets[i].y - 5 <=
-                 asteroids[j].y + asteroids[j].size * AST_RADIUS))
-            {
-              /* Remove bullet! */
+            /* Remove bullet! */
 
-              bullets[i].timer = 0;
+            bullets[i].timer = 0;
 
 
-              hurt_asteroid(j, bullets[i].xm, bullets[i].ym,
-                            asteroids[j].size * 3);
-            }
+            hurt_asteroid(j, bullets[i].xm, bullets[i].ym,
+                          asteroids[j].size * 3);
           }
         }
       }
     }
+  }
 
 
-    /* Move asteroids: */
+  /* Move asteroids: */
 
-    num_asteroids_alive = 0;
+  num_asteroids_alive = 0;
 
-    for (i = 0; i < NUM_ASTEROIDS; i++)
+  for (i = 0; i < NUM_ASTEROIDS; i++)
+  {
+    if (asteroids[i].alive)
     {
-      if (asteroids[i].alive)
-      {
-        num_asteroids_alive++;
+      num_asteroids_alive++;
 
-        /* Move asteroid: */
+      /* Move asteroid: */
 
-        if ((counter % 4) == 0)
-        {
-          asteroids[i].x = asteroids[i].x + asteroids[i].xm;
-          asteroids[i].y = asteroids[i].y + asteroids[i].ym;
-        }
+      if ((game_counter % 4) == 0)
+      {
+        asteroids[i].x = asteroids[i].x + asteroids[i].xm;
+        asteroids[i].y = asteroids[i].y + asteroids[i].ym;
+      }
 
 
-        /* Wrap asteroid around edges of screen: */
+      /* Wrap asteroid around edges of screen: */
 
-        if (asteroids[i].x >= WIDTH)
-          asteroids[i].x = asteroids[i].x - WIDTH;
-        else if (asteroids[i].x < 0)
-          asteroids[i].x = asteroids[i].x + WIDTH;
+      if (asteroids[i].x >= WIDTH)
+        asteroids[i].x = asteroids[i].x - WIDTH;
+      else if (asteroids[i].x < 0)
+        asteroids[i].x = asteroids[i].x + WIDTH;
 
-        if (asteroids[i].y >= HEIGHT)
-          asteroids[i].y = asteroids[i].y - HEIGHT;
-        else if (asteroids[i].y < 0)
-          asteroids[i].y = asteroids[i].y + HEIGHT;
+      if (asteroids[i].y >= HEIGHT)
+        asteroids[i].y = asteroids[i].y - HEIGHT;
+      else if (asteroids[i].y < 0)
+        asteroids[i].y = asteroids[i].y + HEIGHT;
 
 
-        /* Rotate asteroid: */
+      /* Rotate asteroid: */
 
-        asteroids[i].angle = (asteroids[i].angle + asteroids[i].angle_m);
+      asteroids[i].angle = (asteroids[i].angle + asteroids[i].angle_m);
 
 
-        /* Wrap rotation angle... */
+      /* Wrap rotation angle... */
 
-        if (asteroids[i].angle < 0)
-          asteroids[i].angle = asteroids[i].angle + 360;
-        else if (asteroids[i].angle >= 360)
-          asteroids[i].angle = asteroids[i].angle - 360;
+      if (asteroids[i].angle < 0)
+        asteroids[i].angle = asteroids[i].angle + 360;
+      else if (asteroids[i].angle >= 360)
+        asteroids[i].angle = asteroids[i].angle - 360;
 
 
-        /* See if we collided with the player: */
+      /* See if we collided with the player: */
 
-        if (asteroids[i].x >= (x >> 4) - SHIP_RADIUS &&
-            asteroids[i].x <= (x >> 4) + SHIP_RADIUS &&
-            asteroids[i].y >= (y >> 4) - SHIP_RADIUS &&
-            asteroids[i].y <= (y >> 4) + SHIP_RADIUS && player_alive)
-        {
-          hurt_asteroid(i, xm >> 4, ym >> 4, NUM_BITS);
+      if (asteroids[i].x >= (x >> 4) - SHIP_RADIUS &&
+          asteroids[i].x <= (x >> 4) + SHIP_RADIUS &&
+          asteroids[i].y >= (y >> 4) - SHIP_RADIUS &&
+          asteroids[i].y <= (y >> 4) + SHIP_RADIUS && player_alive)
+      {
+        hurt_asteroid(i, xm >> 4, ym >> 4, NUM_BITS);
 
-          player_alive = 0;
-          player_die_timer = 30;
+        player_alive = 0;
+        player_die_timer = 30;
 
-          playsound(SND_EXPLODE);
+        playsound(SND_EXPLODE);
 
-          /* Stop thruster sound: */
+        /* Stop thruster sound: */
 
 #ifndef NOSOUND
-          if (use_sound)
+        if (use_sound)
+        {
+          if (Mix_Playing(CHAN_THRUST))
           {
-            if (Mix_Playing(CHAN_THRUST))
-            {
 #ifndef EMBEDDED
-              Mix_HaltChannel(CHAN_THRUST);
+            Mix_HaltChannel(CHAN_THRUST);
 #endif
-            }
           }
+        }
 #endif
 
-          lives--;
+        lives--;
 
-          if (lives == 0)
-          {
+        if (lives == 0)
+        {
 #ifndef NOSOUND
-            if (use_sound)
-            {
-              playsound(SND_GAMEOVER);
-              playsound(SND_GAMEOVER);
-              playsound(SND_GAMEOVER);
-              /* Mix_PlayChannel(CHAN_THRUST,
-                 sounds[SND_GAMEOVER], 0); */
-            }
-#endif
-            player_die_timer = 100;
+          if (use_sound)
+          {
+            playsound(SND_GAMEOVER);
+            playsound(SND_GAMEOVER);
+            playsound(SND_GAMEOVER);
+            /* Mix_PlayChannel(CHAN_THRUST,
+               sounds[SND_GAMEOVER], 0); */
           }
+#endif
+          player_die_timer = 100;
         }
       }
     }
+  }
 
 
-    /* Move bits: */
+  /* Move bits: */
 
-    for (i = 0; i < NUM_BITS; i++)
+  for (i = 0; i < NUM_BITS; i++)
+  {
+    if (bits[i].timer > 0)
     {
-      if (bits[i].timer > 0)
-      {
-        /* Countdown bit's lifespan: */
+      /* Countdown bit's lifespan: */
 
-        bits[i].timer--;
+      bits[i].timer--;
 
 
-        /* Move the bit: */
+      /* Move the bit: */
 
-        bits[i].x = bits[i].x + bits[i].xm;
-        bits[i].y = bits[i].y + bits[i].ym;
+      bits[i].x = bits[i].x + bits[i].xm;
+      bits[i].y = bits[i].y + bits[i].ym;
 
 
-        /* Wrap bit around edges of screen: */
+      /* Wrap bit around edges of screen: */
 
-        if (bits[i].x >= WIDTH)
-          bits[i].x = bits[i].x - WIDTH;
-        else if (bits[i].x < 0)
-          bits[i].x = bits[i].x + WIDTH;
+      if (bits[i].x >= WIDTH)
+        bits[i].x = bits[i].x - WIDTH;
+      else if (bits[i].x < 0)
+        bits[i].x = bits[i].x + WIDTH;
 
-        if (bits[i].y >= HEIGHT)
-          bits[i].y = bits[i].y - HEIGHT;
-        else if (bits[i].y < 0)
-          bits[i].y = bits[i].y + HEIGHT;
-      }
+      if (bits[i].y >= HEIGHT)
+        bits[i].y = bits[i].y - HEIGHT;
+      else if (bits[i].y < 0)
+        bits[i].y = bits[i].y + HEIGHT;
     }
+  }
+
 
+  bench_lap(BENCH_SIM);
 
-    /* Draw asteroids: */
 
-    for (i = 0; i < NUM_ASTEROIDS; i++)
+  /* Draw asteroids: */
+
+  for (i = 0; i < NUM_ASTEROIDS; i++)
+  {
+    if (asteroids[i].alive)
     {
-      if (asteroids[i].alive)
-      {
-        draw_asteroid(asteroids[i].size,
-                      asteroids[i].x, asteroids[i].y,
-                      asteroids[i].angle, asteroids[i].shape);
-      }
+      draw_asteroid(i);
     }
+  }
 
 
-    /* Draw bits: */
+  /* Draw bits: */
 
-    for (i = 0; i < NUM_BITS; i++)
+  for (i = 0; i < NUM_BITS; i++)
+  {
+    if (bits[i].timer > 0)
     {
-      if (bits[i].timer > 0)
-      {
-        draw_line(bits[i].x, bits[i].y, mkcolor(255, 255, 255),
-                  bits[i].x + bits[i].xm,
-                  bits[i].y + bits[i].ym, mkcolor(255, 255, 255));
-      }
+      draw_bit(bits[i].x, bits[i].y, bits[i].xm, bits[i].ym,
+               mkcolor(255, 255, 255));
     }
+  }
 
 
-    /* Draw score: */
+  /* Draw score, level and lives (just as last frame, unless one of them
+     has changed): */
 
+  if (begin_layer(&hud_layer, score, level, lives, 0))
+  {
 #ifndef EMBEDDED
     snprintf(str, sizeof(str), "SCORE %.6d", score);
     draw_text(str, 3, 3, 14, mkcolor(255, 255, 255));
@@ -1799,231 +2529,219 @@ int game(void)
 
     for (i = 0; i < lives; i++)
     {
-      draw_segment(16, 0, mkcolor(255, 255, 255),
-                   4, 135, mkcolor(255, 255, 255),
-                   WIDTH - 10 - i * 10, 20, 90);
-
-      draw_segment(8, 135, mkcolor(255, 255, 255),
-                   0, 0, mkcolor(255, 255, 255), WIDTH - 10 - i * 10, 20, 90);
-
-      draw_segment(0, 0, mkcolor(255, 255, 255),
-                   8, 225, mkcolor(255, 255, 255),
-                   WIDTH - 10 - i * 10, 20, 90);
+      set_vertex(&ship[0], 8, 135, mkcolor(255, 255, 255));
+      set_vertex(&ship[1], 0, 0, mkcolor(255, 255, 255));
+      set_vertex(&ship[2], 8, 225, mkcolor(255, 255, 255));
+      set_vertex(&ship[3], 16, 0, mkcolor(255, 255, 255));
+      set_vertex(&ship[4], 4, 135, mkcolor(255, 255, 255));
 
-      draw_segment(8, 225, mkcolor(255, 255, 255),
-                   16, 0, mkcolor(255, 255, 255),
-                   WIDTH - 10 - i * 10, 20, 90);
+      draw_polyline(ship, 5, FALSE, WIDTH - 10 - i * 10, 20, 90);
     }
+  }
 
+  end_layer(&hud_layer);
 
-    if (player_die_timer > 0)
-    {
-      if (player_die_timer > 30)
-        j = 30;
-      else
-        j = player_die_timer;
-
-      draw_segment((16 * j) / 30, 0, mkcolor(255, 255, 255),
-                   (4 * j) / 30, 135, mkcolor(255, 255, 255),
-                   WIDTH - 10 - i * 10, 20, 90);
-
-      draw_segment((8 * j) / 30, 135, mkcolor(255, 255, 255),
-                   0, 0, mkcolor(255, 255, 255), WIDTH - 10 - i * 10, 20, 90);
-
-      draw_segment(0, 0, mkcolor(255, 255, 255),
-                   (8 * j) / 30, 225, mkcolor(255, 255, 255),
-                   WIDTH - 10 - i * 10, 20, 90);
-
-      draw_segment((8 * j) / 30, 225, mkcolor(255, 255, 255),
-                   (16 * j) / 30, 0, mkcolor(255, 255, 255),
-                   WIDTH - 10 - i * 10, 20, 90);
 
-    }
+  if (player_die_timer > 0)
+  {
+    if (player_die_timer > 30)
+      j = 30;
+    else
+      j = player_die_timer;
 
+    set_vertex(&ship[0], (8 * j) / 30, 135, mkcolor(255, 255, 255));
+    set_vertex(&ship[1], 0, 0, mkcolor(255, 255, 255));
+    set_vertex(&ship[2], (8 * j) / 30, 225, mkcolor(255, 255, 255));
+    set_vertex(&ship[3], (16 * j) / 30, 0, mkcolor(255, 255, 255));
+    set_vertex(&ship[4], (4 * j) / 30, 135, mkcolor(255, 255, 255));
 
-    /* Draw ship: */
+    draw_polyline(ship, 5, FALSE, WIDTH - 10 - lives * 10, 20, 90);
+  }
 
-    if (player_alive)
-    {
-      draw_segment(SHIP_RADIUS, 0, mkcolor(128, 128, 255),
-                   SHIP_RADIUS / 2, 135, mkcolor(0, 0, 192),
-                   x >> 4, y >> 4, angle);
 
-      draw_segment(SHIP_RADIUS / 2, 135, mkcolor(0, 0, 192),
-                   0, 0, mkcolor(64, 64, 230), x >> 4, y >> 4, angle);
+  /* Draw ship: */
 
-      draw_segment(0, 0, mkcolor(64, 64, 230),
-                   SHIP_RADIUS / 2, 225, mkcolor(0, 0, 192),
-                   x >> 4, y >> 4, angle);
+  if (player_alive)
+  {
+    set_vertex(&ship[0], SHIP_RADIUS, 0, mkcolor(128, 128, 255));
+    set_vertex(&ship[1], SHIP_RADIUS / 2, 135, mkcolor(0, 0, 192));
+    set_vertex(&ship[2], 0, 0, mkcolor(64, 64, 230));
+    set_vertex(&ship[3], SHIP_RADIUS / 2, 225, mkcolor(0, 0, 192));
 
-      draw_segment(SHIP_RADIUS / 2, 225, mkcolor(0, 0, 192),
-                   SHIP_RADIUS, 0, mkcolor(128, 128, 255),
-                   x >> 4, y >> 4, angle);
+    draw_polyline(ship, 4, TRUE, x >> 4, y >> 4, angle);
 
 
-      /* Draw flame: */
+    /* Draw flame: */
 
-      if (up_pressed)
-      {
+    if (up_pressed)
+    {
 #ifndef EMBEDDED
-        draw_segment(0, 0, mkcolor(255, 255, 255),
-                     (rand() % 20), 180, mkcolor(255, 0, 0),
-                     x >> 4, y >> 4, angle);
+      draw_segment(0, 0, mkcolor(255, 255, 255),
+                   (rand() % 20), 180, mkcolor(255, 0, 0),
+                   x >> 4, y >> 4, angle);
 #else
-        i = (rand() % 128) + 128;
+      i = (rand() % 128) + 128;
 
-        draw_segment(0, 0, mkcolor(255, i, i),
-                     (rand() % 20), 180, mkcolor(255, i, i),
-                     x >> 4, y >> 4, angle);
+      draw_segment(0, 0, mkcolor(255, i, i),
+                   (rand() % 20), 180, mkcolor(255, i, i),
+                   x >> 4, y >> 4, angle);
 #endif
-      }
     }
+  }
 
 
-    /* Draw bullets: */
+  /* Draw bullets: */
 
-    for (i = 0; i < NUM_BULLETS; i++)
+  for (i = 0; i < NUM_BULLETS; i++)
+  {
+    if (bullets[i].timer >= 0)
     {
-      if (bullets[i].timer >= 0)
-      {
-        draw_line(bullets[i].x - (rand() % 3) - bullets[i].xm * 2,
-                  bullets[i].y - (rand() % 3) - bullets[i].ym * 2,
-                  mkcolor((rand() % 3) * 128,
-                          (rand() % 3) * 128,
-                          (rand() % 3) * 128),
-                  bullets[i].x + (rand() % 3) - bullets[i].xm * 2,
-                  bullets[i].y + (rand() % 3) - bullets[i].ym * 2,
-                  mkcolor((rand() % 3) * 128,
-                          (rand() % 3) * 128, (rand() % 3) * 128));
-
-        draw_line(bullets[i].x + (rand() % 3) - bullets[i].xm * 2,
-                  bullets[i].y - (rand() % 3) - bullets[i].ym * 2,
-                  mkcolor((rand() % 3) * 128,
-                          (rand() % 3) * 128,
-                          (rand() % 3) * 128),
-                  bullets[i].x - (rand() % 3) - bullets[i].xm * 2,
-                  bullets[i].y + (rand() % 3) - bullets[i].ym * 2,
-                  mkcolor((rand() % 3) * 128,
-                          (rand() % 3) * 128, (rand() % 3) * 128));
-
-
-
-        draw_thick_line(bullets[i].x - (rand() % 5),
-                        bullets[i].y - (rand() % 5),
-                        mkcolor((rand() % 3) * 128 + 64,
-                                (rand() % 3) * 128 + 64,
-                                (rand() % 3) * 128 + 64),
-                        bullets[i].x + (rand() % 5),
-                        bullets[i].y + (rand() % 5),
-                        mkcolor((rand() % 3) * 128 + 64,
-                                (rand() % 3) * 128 + 64,
-                                (rand() % 3) * 128 + 64));
-
-        draw_thick_line(bullets[i].x + (rand() % 5),
-                        bullets[i].y - (rand() % 5),
-                        mkcolor((rand() % 3) * 128 + 64,
-                                (rand() % 3) * 128 + 64,
-                                (rand() % 3) * 128 + 64),
-                        bullets[i].x - (rand() % 5),
-                        bullets[i].y + (rand() % 5),
-                        mkcolor((rand() % 3) * 128 + 64,
-                                (rand() % 3) * 128 + 64,
-                                (rand() % 3) * 128 + 64));
-      }
+      draw_sparkle(sparkle_rand() % NUM_SPARKLES,
+                   bullets[i].x - bullets[i].xm * 2,
+                   bullets[i].y - bullets[i].ym * 2);
+      draw_sparkle(NUM_SPARKLES + sparkle_rand() % NUM_SPARKLES,
+                   bullets[i].x, bullets[i].y);
     }
+  }
 
 
 
-    /* Zooming level effect: */
+  /* Zooming level effect: */
 
-    if (text_zoom > 0)
-    {
-      if ((counter % 2) == 0)
-        text_zoom--;
+  if (text_zoom > 0)
+  {
+    if ((game_counter % 2) == 0)
+      text_zoom--;
 
 #ifndef EMBEDDED
-      draw_text(zoom_str, (WIDTH - (strlen(zoom_str) * text_zoom)) / 2,
-                (HEIGHT - text_zoom) / 2,
-                text_zoom, mkcolor(text_zoom * (256 / ZOOM_START), 0, 0));
+    draw_text(zoom_str, (WIDTH - (strlen(zoom_str) * text_zoom)) / 2,
+              (HEIGHT - text_zoom) / 2,
+              text_zoom, mkcolor(text_zoom * (256 / ZOOM_START), 0, 0));
 #else
-      draw_text(zoom_str, (WIDTH - (strlen(zoom_str) * text_zoom)) / 2,
-                (HEIGHT - text_zoom) / 2,
-                text_zoom, mkcolor(text_zoom * (256 / ZOOM_START), 128, 128));
+    draw_text(zoom_str, (WIDTH - (strlen(zoom_str) * text_zoom)) / 2,
+              (HEIGHT - text_zoom) / 2,
+              text_zoom, mkcolor(text_zoom * (256 / ZOOM_START), 128, 128));
 #endif
-    }
+  }
 
 
-    /* Game over? */
+  /* Game over? */
 
-    if (player_alive == 0 && lives == 0)
+  if (player_alive == 0 && lives == 0)
+  {
+    if (player_die_timer > 14)
     {
-      if (player_die_timer > 14)
-      {
-        draw_text("GAME OVER",
-                  (WIDTH - 9 * player_die_timer) / 2,
-                  (HEIGHT - player_die_timer) / 2,
-                  player_die_timer,
-                  mkcolor(rand() % 255, rand() % 255, rand() % 255));
-      }
-      else
-      {
-        draw_text("GAME OVER",
-                  (WIDTH - 9 * 14) / 2,
-                  (HEIGHT - 14) / 2, 14, mkcolor(255, 255, 255));
-
-      }
+      draw_text("GAME OVER",
+                (WIDTH - 9 * player_die_timer) / 2,
+                (HEIGHT - player_die_timer) / 2,
+                player_die_timer,
+                mkcolor(rand() % 255, rand() % 255, rand() % 255));
     }
-
-
-    /* Go to next level? */
-
-    if (num_asteroids_alive == 0)
+    else
     {
-      level++;
+      draw_text("GAME OVER",
+                (WIDTH - 9 * 14) / 2,
+                (HEIGHT - 14) / 2, 14, mkcolor(255, 255, 255));
 
-      reset_level();
     }
+  }
 
 
-    /* Flush and pause! */
+  bench_lap(BENCH_RECORD);
 
-    /* SDL_Flip(screen); *//* SDL1.2 method */
-    SDL_UpdateTexture(screenTexture, NULL, screen->pixels, screen->pitch);
-    SDL_RenderClear(renderer);
-    SDL_RenderCopy(renderer, bkgdTexture, NULL, NULL);
-    SDL_RenderCopy(renderer, screenTexture, NULL, NULL);
-    SDL_RenderPresent(renderer);
 
-    now_time = SDL_GetTicks();
+  /* Go to next level? */
 
-    if (now_time < last_time + (1000 / FPS))
-    {
-      SDL_Delay(last_time + 1000 / FPS - now_time);
-    }
+  if (num_asteroids_alive == 0)
+  {
+    level++;
+
+    reset_level();
   }
-  while (!done);
 
+  bench_lap(BENCH_SIM);
+}
 
-  /* Record, if a high score: */
 
-  if (score >= high)
+/* Draw the latest frame the simulation published, and show it: */
+
+void game_render(void)
+{
+  int show_layer;
+
+  /* (The HUD, rasterized only when it's changed, goes over it all) */
+
+  show_layer = draw_layer(&draw_lists[draw_list_front]);
+
+
+  /* With "--renderer=sdl", the renderer draws it all, on the background: */
+
+  if (use_sdl_renderer)
   {
-    high = score;
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, bkgdTexture, NULL, NULL);
+    render_draw_cmds(&draw_lists[draw_list_front]);
+    bench_lap(BENCH_RASTER);
+    bench_lap(BENCH_UPLOAD);
+
+    if (show_layer)
+      SDL_RenderCopy(renderer, layerTexture, &layer_rect, &layer_rect);
+
+    SDL_RenderPresent(renderer);
+    bench_lap(BENCH_PRESENT);
+    return;
   }
 
 
-  /* Display mouse cursor: */
+  /* With "--zero-copy", draw it all straight into the screen texture: */
 
-  if (fullscreen)
-    SDL_ShowCursor(1);
+  if (zero_copy)
+  {
+    draw_locked_bands(&draw_lists[draw_list_front]);
+    bench_lap(BENCH_RASTER);
+  }
+  else
+  {
+    /* Erase what was drawn last time: */
 
+    erase_drawn_tiles();
+    clear_coverage();
 
-  return (quit);
+
+    /* Rasterize it all; shadows go under everything: */
+
+    flush_draw_cmds(&draw_lists[draw_list_front]);
+    draw_shadows();
+
+    bench_lap(BENCH_RASTER);
+
+
+    /* Flush! */
+
+    /* SDL_Flip(screen); *//* SDL1.2 method */
+    upload_dirty_tiles();
+  }
+
+  bench_lap(BENCH_UPLOAD);
+
+  SDL_RenderClear(renderer);
+
+  if (zero_copy)
+    SDL_RenderCopy(renderer, bkgdTexture, NULL, NULL);
+
+  SDL_RenderCopy(renderer, screenTexture, NULL, NULL);
+
+  if (show_layer)
+    SDL_RenderCopy(renderer, layerTexture, &layer_rect, &layer_rect);
+
+  SDL_RenderPresent(renderer);
+  bench_lap(BENCH_PRESENT);
 }
 
 
 void finish(void)
 {
+  stop_raster_threads();
   SDL_Quit();
 }
 
@@ -2039,6 +2757,12 @@ void setup(int argc, char *argv[])
   score = 0;
   use_sound = TRUE;
   fullscreen = FALSE;
+  num_threads = 1;
+  zero_copy = FALSE;
+  use_sdl_renderer = FALSE;
+  use_indexed = FALSE;
+  render_width = DEFAULT_WIDTH;
+  render_height = DEFAULT_HEIGHT;
 
 
   /* Check command-line options: */
@@ -2110,6 +2834,63 @@ void setup(int argc, char *argv[])
       show_usage(stdout, argv[0]);
       exit(0);
     }
+    else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+    {
+      bench_frames = atoi(argv[++i]);
+
+      if (bench_frames <= 0)
+      {
+        show_usage(stderr, argv[0]);
+        exit(1);
+      }
+    }
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+    {
+      seed = atoi(argv[++i]);
+      seed_set = TRUE;
+    }
+    else if (strcmp(argv[i], "--zero-copy") == 0)
+    {
+      zero_copy = TRUE;
+    }
+    else if (strcmp(argv[i], "--renderer=soft") == 0)
+    {
+      use_sdl_renderer = FALSE;
+    }
+    else if (strcmp(argv[i], "--renderer=sdl") == 0)
+    {
+#ifdef RENDER_GEOMETRY
+      use_sdl_renderer = TRUE;
+#else
+      fprintf(stderr,
+              "\nWarning: \"--renderer=sdl\" needs SDL 2.0.18 or newer; "
+              "using \"--renderer=soft\".\n\n");
+#endif
+    }
+    else if (strcmp(argv[i], "--indexed") == 0)
+    {
+      use_indexed = TRUE;
+    }
+    else if (strcmp(argv[i], "--render-size") == 0 && i + 1 < argc)
+    {
+      if (sscanf(argv[++i], "%dx%d", &render_width, &render_height) != 2 ||
+          render_width < MIN_WIDTH || render_width > MAX_WIDTH ||
+          render_height < MIN_HEIGHT || render_height > MAX_HEIGHT)
+      {
+        show_usage(stderr, argv[0]);
+        exit(1);
+      }
+    }
+    else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+    {
+      num_threads = atoi(argv[++i]);
+
+      if (num_threads < 1 || num_threads > MAX_THREADS)
+      {
+        show_usage(stderr, argv[0]);
+        exit(1);
+      }
+    }
     else
     {
       show_usage(stderr, argv[0]);
@@ -2118,9 +2899,40 @@ void setup(int argc, char *argv[])
   }
 
 
+  /* (An indexed screen is never drawn into the texture directly, and
+     RGB565 has no alpha to see the background through) */
+
+  if (use_indexed)
+    zero_copy = FALSE;
+
+#ifdef EMBEDDED
+  zero_copy = FALSE;
+#endif
+
+
   /* Seed random number generator: */
 
-  srand(SDL_GetTicks());
+  if (bench_frames > 0 && !seed_set)
+  {
+    /* (Benchmarks should replay the same game every time) */
+
+    seed = 1;
+    seed_set = TRUE;
+  }
+
+  if (seed_set)
+    srand(seed);
+  else
+    srand(SDL_GetTicks());
+
+
+  /* Benchmarks run headless, using SDL's dummy drivers: */
+
+  if (bench_frames > 0)
+  {
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+  }
 
 
   /* Init SDL video: */
@@ -2234,6 +3046,31 @@ void setup(int argc, char *argv[])
   }
 
 
+  /* Start the rasterizer threads, with empty display lists: */
+
+  start_raster_threads();
+  reset_draw_lists();
+  build_sparkles();
+  setup_quads();
+
+
+  /* (Not every renderer can draw geometry; try a triangle, see-through and
+     of no size, and rasterize in software if it can't) */
+
+#ifdef RENDER_GEOMETRY
+  if (use_sdl_renderer &&
+      SDL_RenderGeometry(renderer, NULL, quad_verts, 3, NULL, 0) < 0)
+  {
+    fprintf(stderr,
+            "\nWarning: I could not draw with the SDL renderer; "
+            "using \"--renderer=soft\".\n"
+            "The Simple DirectMedia error that occured was:\n"
+            "%s\n\n", SDL_GetError());
+    use_sdl_renderer = FALSE;
+  }
+#endif
+
+
   /* Load background image: */
 
 #ifndef EMBEDDED
@@ -2259,8 +3096,6 @@ void setup(int argc, char *argv[])
             "%s\n\n", SDL_GetError());
     exit(1);
   }
-  bkgdTexture = SDL_CreateTextureFromSurface(renderer, bkgd);
-
   SDL_FreeSurface(tmp);
 
 #else
@@ -2277,7 +3112,7 @@ void setup(int argc, char *argv[])
     exit(1);
   }
 
-  bkgd = SDL_DisplayFormat(tmp);
+  bkgd = SDL_ConvertSurfaceFormat(tmp, SCREEN_FORMAT, 0);
   if (bkgd == NULL)
   {
     fprintf(stderr,
@@ -2292,6 +3127,92 @@ void setup(int argc, char *argv[])
 #endif
 
 
+  /* (Stretched once, to fit any other "--render-size") */
+
+  if (bkgd->w != WIDTH || bkgd->h != HEIGHT)
+  {
+    tmp = SDL_CreateRGBSurfaceWithFormat(0, WIDTH, HEIGHT,
+                                         bkgd->format->BitsPerPixel,
+                                         bkgd->format->format);
+
+    if (tmp == NULL || SDL_BlitScaled(bkgd, NULL, tmp, NULL) < 0)
+    {
+      fprintf(stderr,
+              "\nError: I couldn't scale the background image to "
+              "%dx%d!\n"
+              "The Simple DirectMedia error that occured was:\n"
+              "%s\n\n", WIDTH, HEIGHT, SDL_GetError());
+      exit(1);
+    }
+
+    SDL_FreeSurface(bkgd);
+    bkgd = tmp;
+  }
+
+
+  /* With "--indexed", the background's copied as it's expanded, so keep
+     it in the screen texture's format: */
+
+  if (use_indexed)
+  {
+    index_bkgd = SDL_ConvertSurfaceFormat(bkgd, SCREEN_FORMAT, 0);
+
+    if (index_bkgd == NULL)
+    {
+      fprintf(stderr,
+              "\nError: I couldn't convert the background image"
+              "to the display format!\n"
+              "The Simple DirectMedia error that occured was:\n"
+              "%s\n\n", SDL_GetError());
+      exit(1);
+    }
+  }
+
+
+  /* With "--zero-copy", the background is only ever drawn by the renderer,
+     with the (mostly see-through) screen texture blended over it; with
+     "--renderer=sdl", the renderer draws everything else on it, too: */
+
+  if (zero_copy || use_sdl_renderer)
+  {
+    bkgdTexture = SDL_CreateTextureFromSurface(renderer, bkgd);
+
+    if (bkgdTexture == NULL ||
+        SDL_SetTextureBlendMode(screenTexture, SDL_BLENDMODE_BLEND) < 0)
+    {
+      fprintf(stderr,
+              "\nError: I couldn't set up the background texture!\n"
+              "The Simple DirectMedia error that occured was:\n"
+              "%s\n\n", SDL_GetError());
+      exit(1);
+    }
+  }
+
+
+  /* The HUD and title credits (see draw_layer()) are drawn in the screen's
+     format, then kept in a texture of their own, blended over each frame: */
+
+  layer_surface = SDL_CreateRGBSurfaceWithFormat(0, WIDTH, HEIGHT,
+                                                 SDL_BITSPERPIXEL
+                                                 (SCREEN_FORMAT),
+                                                 SCREEN_FORMAT);
+  layerTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                   SDL_TEXTUREACCESS_STREAMING,
+                                   WIDTH, HEIGHT);
+
+  if (layer_surface == NULL || layerTexture == NULL ||
+      SDL_SetTextureBlendMode(layerTexture, SDL_BLENDMODE_BLEND) < 0)
+  {
+    fprintf(stderr,
+            "\nError: I couldn't set up the layer texture!\n"
+            "The Simple DirectMedia error that occured was:\n"
+            "%s\n\n", SDL_GetError());
+    exit(1);
+  }
+
+  SDL_FillRect(layer_surface, NULL, LAYER_KEY);
+
+
 #ifndef NOSOUND
   /* Init sound: */
 
@@ -2378,54 +3299,102 @@ void seticon(void)
 }
 
 
-/* Fast approximate-integer, table-based cosine! Whee! */
+/* Fast approximate-integer, table-based sine! Whee!  Angles are in
+   degrees (any whole number of them, as the table wraps around by
+   masking), and the result is in 1/1024ths: */
 
-int fast_cos(int angle)
+int fast_sin(int angle)
 {
-  angle = (angle % 45);
-
-  if (angle < 12)
-    return (trig[angle]);
-  else if (angle < 23)
-    return (-trig[10 - (angle - 12)]);
-  else if (angle < 34)
-    return (-trig[angle - 22]);
-  else
-    return (trig[45 - angle]);
+  return (sine[((angle * TRIG_PER_DEGREE) >> 10) & (TRIG_STEPS - 1)]);
 }
 
 
-/* Sine based on fast cosine... */
+/* Cosine is just sine, a quarter turn along: */
 
-int fast_sin(int angle)
+int fast_cos(int angle)
 {
-  return (-fast_cos((angle + 11) % 45));
+  return (sine[(((angle * TRIG_PER_DEGREE) >> 10) + TRIG_STEPS / 4) &
+               (TRIG_STEPS - 1)]);
 }
 
 
-/* Draw a line: */
+/* Draw a line, wrapping around the edges of the screen: */
 
 void draw_line(int x1, int y1, color_type c1, int x2, int y2, color_type c2)
 {
-  sdl_drawline(x1, y1, c1, x2, y2, c2);
+  int xs[3], ys[3], nx, ny, i, j;
 
-  if (x1 < 0 || x2 < 0)
-  {
-    sdl_drawline(x1 + WIDTH, y1, c1, x2 + WIDTH, y2, c2);
-  }
-  else if (x1 >= WIDTH || x2 >= WIDTH)
+  nx = wrap_offsets(x1, x2, WIDTH, xs);
+  ny = wrap_offsets(y1, y2, HEIGHT, ys);
+
+  for (j = 0; j < ny; j++)
   {
-    sdl_drawline(x1 - WIDTH, y1, c1, x2 - WIDTH, y2, c2);
+    for (i = 0; i < nx; i++)
+    {
+      sdl_drawline(x1 + xs[i], y1 + ys[j], c1,
+                   x2 + xs[i], y2 + ys[j], c2);
+    }
   }
+}
+
+
+/* Draw a line that's known to be entirely on the screen (no wrapping,
+   no clipping): */
+
+void draw_line_on_screen(int x1, int y1, color_type c1,
+                         int x2, int y2, color_type c2)
+{
+  record_line(x1, y1, c1, x2, y2, c2, 0, line_steps(x1, y1, x2, y2));
+}
+
+
+/* Which of the copies of a line (a screen to the left, none, or a screen to
+   the right -- or up or down) reach the screen along one axis?  Fills in
+   their offsets and returns how many there are.  (Copies in both
+   directions at once cover lines crossing a corner.) */
+
+int wrap_offsets(int a, int b, int size, int *offsets)
+{
+  int lo, hi, off, n;
 
-  if (y1 < 0 || y2 < 0)
+  lo = a;
+  hi = b;
+  if (lo > hi)
   {
-    sdl_drawline(x1, y1 + HEIGHT, c1, x2, y2 + HEIGHT, c2);
+    lo = b;
+    hi = a;
   }
-  else if (y1 >= HEIGHT || y2 >= HEIGHT)
+
+  n = 0;
+
+  for (off = -size; off <= size; off = off + size)
   {
-    sdl_drawline(x1, y1 - HEIGHT, c1, x2, y2 - HEIGHT, c2);
+    if (hi + off >= 0 && lo + off < size)
+    {
+      offsets[n] = off;
+      n++;
+    }
   }
+
+  return n;
+}
+
+
+/* Is a circle entirely on the screen, entirely off of it (and all of its
+   wrapped copies), or on an edge? */
+
+int cull_circle(int x, int y, int r)
+{
+  int offsets[3];
+
+  if (x - r >= 0 && x + r < WIDTH && y - r >= 0 && y + r < HEIGHT)
+    return CULL_INSIDE;
+
+  if (wrap_offsets(x - r, x + r, WIDTH, offsets) == 0 ||
+      wrap_offsets(y - r, y + r, HEIGHT, offsets) == 0)
+    return CULL_OUTSIDE;
+
+  return CULL_EDGE;
 }
 
 
@@ -2452,582 +3421,2678 @@ color_type mkcolor(int r, int g, int b)
 
 /* Draw a line on an SDL surface: */
 
+/* (Integer DDA.  Column k of the line, counting from x1 up to -- but not
+   including -- x2, covers rows Y(k) through Y(k + 1), where
+   Y(k) = y1 + floor(k * dy / |dx|).  Shallow lines come out as horizontal
+   runs, one per row, shaded per column; steep lines as vertical runs,
+   one per column, shaded per row.  Only the columns clip() leaves are
+   visited, but everything is measured from the unclipped line.) */
+
 void sdl_drawline(int x1, int y1, color_type c1,
                   int x2, int y2, color_type c2)
 {
-  int dx, dy;
-#ifndef EMBEDDED
-  float cr, cg, cb, rd, gd, bd;
-#endif
-  float m, b;
-
-
-  if (clip(&x1, &y1, &x2, &y2))
-  {
-    dx = x2 - x1;
-    dy = y2 - y1;
+  int k0, k1;
 
-    if (dx != 0)
-    {
-      m = ((float) dy) / ((float) dx);
-      b = y1 - m * x1;
-
-      if (x2 >= x1)
-        dx = 1;
-      else
-        dx = -1;
+  if (clip(x1, y1, x2, y2, &k0, &k1))
+    record_line(x1, y1, c1, x2, y2, c2, k0, k1);
+}
 
-#ifndef EMBEDDED
-      cr = c1.r;
-      cg = c1.g;
-      cb = c1.b;
 
-      rd = (float) (c2.r - c1.r) / (float) (x2 - x1) * dx;
-      gd = (float) (c2.g - c1.g) / (float) (x2 - x1) * dx;
-      bd = (float) (c2.b - c1.b) / (float) (x2 - x1) * dx;
-#endif
+/* Add a line to the display list (see clip() for the "k"s): */
 
-      while (x1 != x2)
-      {
-        y1 = m * x1 + b;
-        y2 = m * (x1 + dx) + b;
+void record_line(int x1, int y1, color_type c1,
+                 int x2, int y2, color_type c2, int k0, int k1)
+{
+  draw_cmd_type *cmd;
 
-#ifndef EMBEDDED
-        drawvertline(x1, y1, mkcolor(cr, cg, cb),
-                     y2, mkcolor(cr + rd, cg + gd, cb + bd));
-#else
-        drawvertline(x1, y1, mkcolor(c1.r, c1.g, c1.b),
-                     y2, mkcolor(c1.r, c1.g, c1.b));
-#endif
 
-        x1 = x1 + dx;
+  /* A sloped line never draws its far end (see rasterize_line()), but a
+     vertical one does; leave it to the next edge of an outline: */
 
+  if (skipping_line_ends && x1 == x2 && k1 == abs(y2 - y1))
+  {
+    k1--;
 
-#ifndef EMBEDDED
-        cr = cr + rd;
-        cg = cg + gd;
-        cb = cb + bd;
-#endif
-      }
-    }
-    else
-      drawvertline(x1, y1, c1, y2, c2);
+    if (k1 < k0)
+      return;
   }
+
+  cmd = new_draw_cmd();
+
+  cmd->x1 = x1;
+  cmd->y1 = y1;
+  cmd->x2 = x2;
+  cmd->y2 = y2;
+  cmd->k0 = k0;
+  cmd->k1 = k1;
+  cmd->c1 = c1;
+  cmd->c2 = c2;
+  cmd->kind = DRAW_LINE;
 }
 
 
-/* Clip lines to window: */
+/* Rasterize everything on a display list, and empty it: */
 
-int clip(int *x1, int *y1, int *x2, int *y2)
+void flush_draw_cmds(draw_list_type * list)
 {
-#ifndef EMBEDDED
+  rasterize_list(list);
+
+  list->num_cmds = 0;
+  list->num_bit_segs = 0;
+}
 
-  float fx1, fx2, fy1, fy2, tmp;
-  float m;
-  unsigned char code1, code2;
-  int done, draw, swapped;
-  unsigned char ctmp;
-  fx1 = (float) *x1;
-  fy1 = (float) *y1;
-  fx2 = (float) *x2;
-  fy2 = (float) *y2;
 
+/* Rasterize what's on a display list within rows "raster_top" up to (but
+   not including) "raster_bottom" (usually the whole screen; see
+   draw_locked_bands()): */
 
-  done = FALSE;
-  draw = FALSE;
-  m = 0;
-  swapped = FALSE;
+void rasterize_list(draw_list_type * list)
+{
+  int i, b, top, bottom, first, last;
+  draw_cmd_type *cmd;
 
+  flush_list = list;
 
-  while (!done)
+  if (raster_threads <= 1)
+  {
+    for (i = 0; i < list->num_cmds; i++)
+      rasterize_cmd(&list->cmds[i], raster_top, raster_bottom);
+  }
+  else
   {
-    code1 = encode(fx1, fy1);
-    code2 = encode(fx2, fy2);
+    /* Sort the commands into the bands their rows fall in... */
 
-    if (!(code1 | code2))
-    {
-      done = TRUE;
-      draw = TRUE;
-    }
-    else if (code1 & code2)
-    {
-      done = TRUE;
-    }
-    else
+    if (list->num_cmds > max_band_cmds)
     {
-      if (!code1)
-      {
-        swapped = TRUE;
-        tmp = fx1;
-        fx1 = fx2;
-        fx2 = tmp;
+      max_band_cmds = list->max_cmds;
 
-        tmp = fy1;
-        fy1 = fy2;
-        fy2 = tmp;
+      for (b = 0; b < MAX_THREADS; b++)
+      {
+        band_cmds[b] = realloc(band_cmds[b], max_band_cmds * sizeof(int));
 
-        ctmp = code1;
-        code1 = code2;
-        code2 = ctmp;
+        if (band_cmds[b] == NULL)
+        {
+          fprintf(stderr, "\nError: I couldn't grow the display list!\n\n");
+          exit(1);
+        }
       }
+    }
 
+    for (b = 0; b < raster_threads; b++)
+      num_band_cmds[b] = 0;
 
-      if (fx2 != fx1)
-        m = (fy2 - fy1) / (fx2 - fx1);
-      else
-        m = 1;
+    for (i = 0; i < list->num_cmds; i++)
+    {
+      cmd = &list->cmds[i];
 
-      if (code1 & LEFT_EDGE)
-      {
-        fy1 += ((0 - (fx1)) * m);
-        fx1 = 0;
-      }
-      else if (code1 & RIGHT_EDGE)
-      {
-        fy1 += (((WIDTH - 1) - (fx1)) * m);
-        fx1 = (WIDTH - 1);
-      }
-      else if (code1 & TOP_EDGE)
-      {
-        if (fx2 != fx1)
-          fx1 += ((0 - (fy1)) / m);
-        fy1 = 0;
-      }
-      else if (code1 & BOTTOM_EDGE)
+      top = cmd->y1;
+      bottom = cmd->y2;
+      if (top > bottom)
       {
-        if (fx2 != fx1)
-          fx1 += (((HEIGHT - 1) - (fy1)) / m);
-        fy1 = (HEIGHT - 1);
+        top = cmd->y2;
+        bottom = cmd->y1;
       }
-    }
-  }
 
+      if (bottom < raster_top || top >= raster_bottom)
+        continue;
 
-  if (swapped)
-  {
-    tmp = fx1;
-    fx1 = fx2;
-    fx2 = tmp;
+      first = band_of_row(top < raster_top ? raster_top : top);
+      last = band_of_row(bottom >= raster_bottom ? raster_bottom - 1 : bottom);
 
-    tmp = fy1;
-    fy1 = fy2;
-    fy2 = tmp;
-  }
+      for (b = first; b <= last; b++)
+        band_cmds[b][num_band_cmds[b]++] = i;
+    }
 
 
-  *x1 = (int) fx1;
-  *y1 = (int) fy1;
-  *x2 = (int) fx2;
-  *y2 = (int) fy2;
+    /* ...and have each thread draw its own band: */
 
-  return (draw);
-#else
+    run_raster_job(RASTER_LINES);
+  }
+}
 
-  if (*x1 < 0 || *x1 >= WIDTH ||
-      *y1 < 0 || *y1 >= HEIGHT ||
-      *x2 < 0 || *x2 >= WIDTH || *y2 < 0 || *y2 >= HEIGHT)
-    return FALSE;
-  else
-    return TRUE;
 
+/* Add a command to the display list being recorded.  A frame can need any
+   number of them (the HUD draws every extra life), so rather than drop
+   any, the list grows.  (Each list is only ever touched by one thread at
+   a time; see publish_draw_list().) */
 
-#endif
+draw_cmd_type *new_draw_cmd(void)
+{
+  if (record_list->num_cmds >= record_list->max_cmds)
+    grow_draw_list(record_list, record_list->num_cmds + 1);
+
+  return (&record_list->cmds[record_list->num_cmds++]);
 }
 
 
-/* Where does this line clip? */
+/* Make room for at least "n" commands on a display list: */
 
-unsigned char encode(float x, float y)
+void grow_draw_list(draw_list_type * list, int n)
 {
-  unsigned char code;
+  int max;
 
-  code = 0x00;
+  if (n <= list->max_cmds)
+    return;
 
-  if (x < 0.0)
-    code = code | LEFT_EDGE;
-  else if (x >= (float) WIDTH)
-    code = code | RIGHT_EDGE;
+  max = (list->max_cmds > 0 ? list->max_cmds : DRAW_LIST_CMDS);
 
-  if (y < 0.0)
-    code = code | TOP_EDGE;
-  else if (y >= (float) HEIGHT)
-    code = code | BOTTOM_EDGE;
+  while (max < n)
+    max = max * 2;
 
-  return code;
+  list->cmds = realloc(list->cmds, max * sizeof(draw_cmd_type));
+
+  if (list->cmds == NULL)
+  {
+    fprintf(stderr, "\nError: I couldn't grow the display list!\n\n");
+    exit(1);
+  }
+
+  list->max_cmds = max;
 }
 
 
-/* Draw a verticle line: */
+/* Rasterize one command, within rows "top" up to (but not including)
+   "bottom": */
 
-void drawvertline(int x, int y1, color_type c1, int y2, color_type c2)
+void rasterize_cmd(draw_cmd_type *cmd, int top_row, int bottom_row)
 {
-  int tmp, dy;
-#ifndef EMBEDDED
-  float cr, cg, cb, rd, gd, bd;
-#else
-  int cr, cg, cb;
-#endif
+  if (cmd->kind == DRAW_GLYPH)
+    blit_glyph(cmd, top_row, bottom_row);
+  else if (cmd->kind == DRAW_SPARKLE)
+    blit_sparkle(cmd, top_row, bottom_row);
+  else if (cmd->kind == DRAW_BITS)
+    plot_bits(cmd, top_row, bottom_row);
+  else
+    rasterize_line(cmd->x1, cmd->y1, cmd->c1, cmd->x2, cmd->y2,
+                   cmd->c2, cmd->k0, cmd->k1, top_row, bottom_row);
+}
 
-  if (y1 > y2)
-  {
-    tmp = y1;
-    y1 = y2;
-    y2 = tmp;
 
-#ifndef EMBEDDED
-    tmp = c1.r;
-    c1.r = c2.r;
-    c2.r = tmp;
+/* The display lists are triple-buffered, so the simulation never waits on
+   the renderer, nor the renderer on the simulation:  the simulation records
+   into the "back" list, the renderer draws from the "front" one, and the
+   "middle" one holds the newest finished frame (marked "fresh" until the
+   renderer takes it).  Only the middle changes hands, with one atomic swap
+   on either side.  Start them all afresh: */
 
-    tmp = c1.g;
-    c1.g = c2.g;
-    c2.g = tmp;
+void reset_draw_lists(void)
+{
+  draw_list_back = 0;
+  draw_list_front = 1;
+  SDL_AtomicSet(&draw_list_middle, 2);
 
-    tmp = c1.b;
-    c1.b = c2.b;
-    c2.b = tmp;
-#endif
-  }
+  record_list = &draw_lists[draw_list_back];
+  record_list->num_cmds = 0;
+  record_list->num_bit_segs = 0;
+}
 
-  cr = c1.r;
-  cg = c1.g;
-  cb = c1.b;
 
-#ifndef EMBEDDED
-  if (y1 != y2)
-  {
-    rd = (float) (c2.r - c1.r) / (float) (y2 - y1);
-    gd = (float) (c2.g - c1.g) / (float) (y2 - y1);
-    bd = (float) (c2.b - c1.b) / (float) (y2 - y1);
-  }
-  else
-  {
-    rd = 0;
-    gd = 0;
-    bd = 0;
-  }
-#endif
+/* Publish the frame just recorded (replacing any the renderer hasn't gotten
+   to yet), and start the next one on the list that was in the middle: */
 
-  for (dy = y1; dy <= y2; dy++)
-  {
-    if (drawn_at[dy + 1][x + 1] == 0)
-      putpixel(screen, x + 1, dy + 1, SDL_MapRGB(screen->format, 0, 0, 0));
+void publish_draw_list(void)
+{
+  SDL_MemoryBarrierRelease();
 
-    putpixel(screen, x, dy, SDL_MapRGB(screen->format,
-                                       (Uint8) cr, (Uint8) cg, (Uint8) cb));
-    drawn_at[dy][x] = 1;
+  draw_list_back = (SDL_AtomicSet(&draw_list_middle,
+                                  draw_list_back | DRAW_LIST_FRESH) &
+                    ~DRAW_LIST_FRESH);
 
-#ifndef EMBEDDED
-    cr = cr + rd;
-    cg = cg + gd;
-    cb = cb + bd;
-#endif
-  }
+  record_list = &draw_lists[draw_list_back];
+  record_list->num_cmds = 0;
+  record_list->num_bit_segs = 0;
 }
 
 
-/* Draw a single pixel into the surface: */
+/* Take the newest published frame for drawing; returns FALSE if there's
+   been nothing new since last time: */
 
-void putpixel(SDL_Surface *surface, int x, int y, Uint32 pixel)
+int take_draw_list(void)
 {
-  int bpp;
-  Uint8 *p;
+  if ((SDL_AtomicGet(&draw_list_middle) & DRAW_LIST_FRESH) == 0)
+    return (FALSE);
 
+  draw_list_front = (SDL_AtomicSet(&draw_list_middle, draw_list_front) &
+                     ~DRAW_LIST_FRESH);
 
-  /* Assuming the X/Y values are within the bounds of this surface... */
+  SDL_MemoryBarrierAcquire();
 
-  if (x >= 0 && y >= 0 && x < WIDTH && y < HEIGHT)
-  {
-    /* Determine bytes-per-pixel for the surface in question: */
+  return (TRUE);
+}
 
-    bpp = surface->format->BytesPerPixel;
 
+/* Start drawing a layer.  If it's already been recorded from the same
+   values, there's nothing to draw, and this returns FALSE.  Otherwise,
+   drawing goes into the layer (rather than the frame) until end_layer(): */
 
-    /* Set a pointer to the exact location in memory of the pixel
-       in question: */
+int begin_layer(layer_type * layer, int k1, int k2, int k3, int k4)
+{
+  if (layer->valid && layer->key[0] == k1 && layer->key[1] == k2 &&
+      layer->key[2] == k3 && layer->key[3] == k4)
+    return (FALSE);
 
-    p = (((Uint8 *) surface->pixels) +  /* Start at beginning of RAM */
-         (y * surface->pitch) + /* Go down Y lines */
-         (x * bpp));            /* Go in X pixels */
+  layer->key[0] = k1;
+  layer->key[1] = k2;
+  layer->key[2] = k3;
+  layer->key[3] = k4;
+  layer->valid = TRUE;
 
+  layer_serials++;
+  layer->serial = layer_serials;
 
-    /* Set the (correctly-sized) piece of data in the surface's RAM
-       to the pixel value sent in: */
+  layer_saved_list = record_list;
+  record_list = &layer->list;
+  record_list->num_cmds = 0;
+  record_list->num_bit_segs = 0;
 
-    if (bpp == 1)
-      *p = pixel;
-    else if (bpp == 2)
-      *(Uint16 *) p = pixel;
-    else if (bpp == 3)
-    {
-      if (SDL_BYTEORDER == SDL_BIG_ENDIAN)
-      {
-        p[0] = (pixel >> 16) & 0xff;
-        p[1] = (pixel >> 8) & 0xff;
-        p[2] = pixel & 0xff;
-      }
-      else
-      {
-        p[0] = pixel & 0xff;
-        p[1] = (pixel >> 8) & 0xff;
-        p[2] = (pixel >> 16) & 0xff;
-      }
-    }
-    else if (bpp == 4)
-    {
-      *(Uint32 *) p = pixel;
-    }
-  }
+  return (TRUE);
 }
 
 
+/* Finish a layer (if it was being drawn), and add its commands to the
+   frame being recorded, marked as the layer's.  (They're still copied
+   every frame, since the renderer may not have seen this recording yet,
+   but it only rasterizes them when it hasn't; see draw_layer().) */
 
-/* Draw a line segment, rotated around a center point: */
-
-void draw_segment(int r1, int a1,
-                  color_type c1,
-                  int r2, int a2, color_type c2, int cx, int cy, int a)
+void end_layer(layer_type * layer)
 {
-  draw_line(((fast_cos((a1 + a) >> 3) * r1) >> 10) + cx,
-            cy - ((fast_sin((a1 + a) >> 3) * r1) >> 10),
-            c1,
-            ((fast_cos((a2 + a) >> 3) * r2) >> 10) + cx,
-            cy - ((fast_sin((a2 + a) >> 3) * r2) >> 10), c2);
+  int n;
+
+  if (record_list == &layer->list)
+    record_list = layer_saved_list;
+
+  n = layer->list.num_cmds;
+  grow_draw_list(record_list, record_list->num_cmds + n);
+
+  memcpy(&record_list->cmds[record_list->num_cmds], layer->list.cmds,
+         n * sizeof(draw_cmd_type));
+
+  record_list->layer_first = record_list->num_cmds;
+  record_list->layer_cmds = n;
+  record_list->layer_serial = layer->serial;
+
+  record_list->num_cmds += n;
 }
 
 
-/* Add a bullet: */
+/* Take a frame's layer off its display list, and (unless it's the same
+   recording as last time) rasterize it, with its shadows, into
+   "layer_surface", and from there into the layer texture.  The layer is
+   shown by blending that over the rest of the frame, so its pixels are
+   never drawn, erased or uploaded along with the frame's.  (Unless
+   something else in the frame comes near it; see near_layer().)  Returns
+   whether there's a layer to show: */
 
-int add_bullet(int x, int y, int a, int xm, int ym)
+int draw_layer(draw_list_type * list)
 {
-  int i, found;
+  int i, y, top, bottom, lo, hi, saved_indexed;
+  SDL_Surface *saved_screen;
 
-  found = -1;
+  if (list->layer_serial == 0)
+    return (FALSE);
 
-  for (i = 0; i < NUM_BULLETS && found == -1; i++)
+  if (list->layer_serial != layer_drawn_serial)
   {
-    if (bullets[i].timer <= 0)
-      found = i;
-  }
+    layer_drawn_serial = list->layer_serial;
 
-  if (found != -1)
-  {
-#ifndef EMBEDDED
-    bullets[found].timer = 50;
-#else
-    bullets[found].timer = 30;
-#endif
 
-    bullets[found].x = x;
-    bullets[found].y = y;
+    /* (Drawn as "screen" would be, but never indexed; the rasterizer
+       threads are idle, and the simulation never looks at either) */
 
-    bullets[found].xm = ((fast_cos(a >> 3) * 5) >> 10) + (xm >> 4);
-    bullets[found].ym = -((fast_sin(a >> 3) * 5) >> 10) + (ym >> 4);
+    saved_screen = screen;
+    saved_indexed = use_indexed;
 
+    screen = layer_surface;
+    use_indexed = FALSE;
+    setup_screen_rows();
 
-    playsound(SND_BULLET);
-  }
+    SDL_FillRect(layer_surface, &layer_rect, LAYER_KEY);
+    clear_coverage();
 
-  return (found != -1);
-}
+    flush_list = list;
 
+    for (i = list->layer_first;
+         i < list->layer_first + list->layer_cmds; i++)
+      rasterize_cmd(&list->cmds[i], 0, HEIGHT);
 
-/* Add an asteroid: */
+    draw_shadow_rows(0, HEIGHT);
 
-void add_asteroid(int x, int y, int xm, int ym, int size)
-{
-  int i, found;
 
+    /* (Its pixels are within the rows and words it covered, and a pixel
+       further down and right, for shadows) */
 
-  /* Find a slot: */
+    top = HEIGHT;
+    bottom = -1;
+    lo = COVERAGE_WORDS;
+    hi = -1;
 
-  found = -1;
+    for (y = 0; y < HEIGHT; y++)
+    {
+      if (coverage_row_used[y])
+      {
+        if (top == HEIGHT)
+          top = y;
+        bottom = y;
+
+        if (coverage_lo[y] < lo)
+          lo = coverage_lo[y];
+        if (coverage_hi[y] > hi)
+          hi = coverage_hi[y];
+      }
+    }
 
-  for (i = 0; i < NUM_ASTEROIDS && found == -1; i++)
-  {
-    if (asteroids[i].alive == 0)
-      found = i;
+    if (bottom < 0)
+    {
+      layer_rect.w = 0;
+      layer_rect.h = 0;
+    }
+    else
+    {
+      layer_rect.x = lo * 32;
+      layer_rect.y = top;
+      layer_rect.w = ((hi + 1) * 32 + 1 < WIDTH ?
+                      (hi + 1) * 32 + 1 : WIDTH) - layer_rect.x;
+      layer_rect.h = (bottom + 2 < HEIGHT ? bottom + 2 : HEIGHT) - top;
+    }
+
+    for (y = layer_rect.y; y < layer_rect.y + layer_rect.h; y++)
+      memcpy(layer_coverage[y], coverage[y], COVERAGE_WORDS * sizeof(Uint32));
+
+    clear_coverage();
+
+    screen = saved_screen;
+    use_indexed = saved_indexed;
+    setup_screen_rows();
+
+    upload_layer();
   }
 
 
-  /* Hack: No asteroids should be stationary! */
+  /* (If anything else would go over or under its pixels, the layer can't
+     simply go on top; this frame, it's drawn in with the rest, in the
+     order it was recorded) */
 
-  while (xm == 0)
+  if (near_layer(list))
   {
-    xm = (rand() % 3) - 1;
+    list->layer_serial = 0;
+    return (FALSE);
   }
 
 
-  if (found != -1)
+  /* (Otherwise, the rest of the frame is drawn without it) */
+
+  memmove(&list->cmds[list->layer_first],
+          &list->cmds[list->layer_first + list->layer_cmds],
+          (list->num_cmds - list->layer_first - list->layer_cmds) *
+          sizeof(draw_cmd_type));
+
+  list->num_cmds = list->num_cmds - list->layer_cmds;
+  list->layer_serial = 0;
+
+  return (layer_rect.w > 0);
+}
+
+
+/* Does anything on a display list, other than its layer, come near the
+   layer's pixels?  (Near enough that one's lines or shadows could land on
+   the other's) */
+
+int near_layer(draw_list_type * list)
+{
+  int i, j;
+  draw_cmd_type *cmd;
+  bit_seg_type *seg;
+
+  for (i = 0; i < list->num_cmds; i++)
   {
-    asteroids[found].alive = 1;
+    if (i >= list->layer_first && i < list->layer_first + list->layer_cmds)
+      continue;
 
-    asteroids[found].x = x;
-    asteroids[found].y = y;
-    asteroids[found].xm = xm;
-    asteroids[found].ym = ym;
+    cmd = &list->cmds[i];
 
-    asteroids[found].angle = (rand() % 360);
-    asteroids[found].angle_m = (rand() % 6) - 3;
+    if (cmd->kind == DRAW_BITS)
+    {
+      /* (A batch spans all its bits; check them one by one) */
 
-    asteroids[found].size = size;
+      for (j = cmd->k0; j < cmd->k0 + cmd->k1; j++)
+      {
+        seg = &list->bit_segs[j];
 
-    for (i = 0; i < AST_SIDES; i++)
+        if (near_layer_lines(seg->x, seg->y,
+                             seg->x + seg->xm, seg->y + seg->ym))
+          return (TRUE);
+      }
+    }
+    else if (near_layer_lines(cmd->x1, cmd->y1, cmd->x2, cmd->y2))
     {
-      asteroids[found].shape[i].radius = (rand() % 3);
-      asteroids[found].shape[i].angle = i * 60 + (rand() % 40);
+      return (TRUE);
     }
   }
+
+  return (FALSE);
 }
 
 
-/* Add a bit: */
+/* Does the layer have lines within a pixel of a box (to the nearest
+   coverage word, across)? */
 
-void add_bit(int x, int y, int xm, int ym)
+int near_layer_lines(int x1, int y1, int x2, int y2)
 {
-  int i, found;
-
-  found = -1;
+  int t, y, w;
 
-  for (i = 0; i < NUM_BITS && found == -1; i++)
+  if (x1 > x2)
   {
-    if (bits[i].timer <= 0)
-      found = i;
+    t = x1;
+    x1 = x2;
+    x2 = t;
   }
 
-
-  if (found != -1)
+  if (y1 > y2)
   {
-    bits[found].timer = 16;
-
-    bits[found].x = x;
-    bits[found].y = y;
-    bits[found].xm = xm;
-    bits[found].ym = ym;
+    t = y1;
+    y1 = y2;
+    y2 = t;
   }
+
+  x1 = x1 - 1;
+  y1 = y1 - 1;
+  x2 = x2 + 1;
+  y2 = y2 + 1;
+
+  if (x1 < layer_rect.x)
+    x1 = layer_rect.x;
+  if (y1 < layer_rect.y)
+    y1 = layer_rect.y;
+  if (x2 >= layer_rect.x + layer_rect.w)
+    x2 = layer_rect.x + layer_rect.w - 1;
+  if (y2 >= layer_rect.y + layer_rect.h)
+    y2 = layer_rect.y + layer_rect.h - 1;
+
+  for (y = y1; y <= y2; y++)
+    for (w = x1 / 32; w <= x2 / 32; w++)
+      if (layer_coverage[y][w] != 0)
+        return (TRUE);
+
+  return (FALSE);
 }
 
 
-/* Draw an asteroid: */
+/* Copy the layer's pixels into its texture, see-through wherever nothing
+   was drawn: */
 
-void draw_asteroid(int size, int x, int y, int angle, shape_type *shape)
+void upload_layer(void)
 {
-  int i, b1, b2;
-  int div;
+  int x, y, pitch;
+  void *pixels;
+  pixel_type *src;
+  Uint32 *dst;
+  Uint8 r, g, b;
 
-#ifndef EMBEDDED
-  div = 240;
-#else
-  div = 120;
-#endif
+  if (layer_rect.w == 0)
+    return;
+
+  if (SDL_LockTexture(layerTexture, &layer_rect, &pixels, &pitch) < 0)
+  {
+    fprintf(stderr,
+            "\nError: I couldn't lock the layer texture!\n"
+            "The Simple DirectMedia error that occured was:\n"
+            "%s\n\n", SDL_GetError());
+    exit(1);
+  }
 
-  for (i = 0; i < AST_SIDES - 1; i++)
+  for (y = 0; y < layer_rect.h; y++)
   {
-    b1 = (((shape[i].angle + angle) % 180) * 255) / div;
-    b2 = (((shape[i + 1].angle + angle) % 180) * 255) / div;
+    src = (pixel_type *) ((Uint8 *) layer_surface->pixels +
+                          (layer_rect.y + y) * layer_surface->pitch) +
+      layer_rect.x;
+    dst = (Uint32 *) ((Uint8 *) pixels + y * pitch);
 
-    draw_segment((size * (AST_RADIUS - shape[i].radius)),
-                 shape[i].angle, mkcolor(b1, b1, b1),
-                 (size * (AST_RADIUS - shape[i + 1].radius)),
-                 shape[i + 1].angle, mkcolor(b2, b2, b2), x, y, angle);
+    for (x = 0; x < layer_rect.w; x++)
+    {
+      if (src[x] == LAYER_KEY)
+      {
+        dst[x] = 0;
+      }
+      else
+      {
+        SDL_GetRGB(src[x], layer_surface->format, &r, &g, &b);
+        dst[x] = 0xFF000000 | (r << 16) | (g << 8) | b;
+      }
+    }
   }
 
-  b1 = (((shape[AST_SIDES - 1].angle + angle) % 180) * 255) / div;
-  b2 = (((shape[0].angle + angle) % 180) * 255) / div;
+  SDL_UnlockTexture(layerTexture);
 
-  draw_segment((size * (AST_RADIUS - shape[AST_SIDES - 1].radius)),
-               shape[AST_SIDES - 1].angle, mkcolor(b1, b1, b1),
-               (size * (AST_RADIUS - shape[0].radius)),
-               shape[0].angle, mkcolor(b2, b2, b2), x, y, angle);
+  bench_uploaded = bench_uploaded + layer_rect.w * layer_rect.h;
+  bench_copied = bench_copied + layer_rect.w * layer_rect.h * sizeof(Uint32);
 }
 
 
-/* Queue a sound! */
+/* Which band (one per thread, of the rows being drawn) is a row in? */
 
-void playsound(int snd)
+int band_of_row(int y)
 {
-  int which;
-#ifndef EMBEDDED
-  int i;
-#endif
+  return (((y - raster_top) * raster_threads) / (raster_bottom - raster_top));
+}
 
-#ifndef NOSOUND
-  if (use_sound)
-  {
-#ifdef EMBEDDED
-    which = -1;
-#else
-    which = (rand() % 3) + CHAN_THRUST;
-    for (i = CHAN_THRUST; i < 4; i++)
-    {
-      if (!Mix_Playing(i))
-        which = i;
-    }
-#endif
 
-    Mix_PlayChannel(which, sounds[snd], 0);
-  }
-#endif
+/* First row of a band (and so one past the last row of the band above): */
+
+int band_top(int band)
+{
+  return (raster_top + (band * (raster_bottom - raster_top) +
+                        raster_threads - 1) / raster_threads);
 }
 
 
-/* Break an asteroid and add an explosion: */
+/* Hand a job to every rasterizer thread, do band 0 here, and wait for the
+   rest to finish: */
 
-void hurt_asteroid(int j, int xm, int ym, int exp_size)
+void run_raster_job(int job)
 {
-  int k;
+  int i;
 
-  add_score(100 / (asteroids[j].size + 1));
+  raster_job = job;
 
-  if (asteroids[j].size > 1)
-  {
-    /* Break the rock into two smaller ones! */
+  for (i = 1; i < raster_threads; i++)
+    SDL_SemPost(raster_go[i]);
 
-    add_asteroid(asteroids[j].x,
-                 asteroids[j].y,
-                 ((asteroids[j].xm + xm) / 2),
-                 (asteroids[j].ym + ym), asteroids[j].size - 1);
+  raster_band(0);
 
-    add_asteroid(asteroids[j].x,
-                 asteroids[j].y,
-                 (asteroids[j].xm + xm),
-                 ((asteroids[j].ym + ym) / 2), asteroids[j].size - 1);
-  }
+  for (i = 1; i < raster_threads; i++)
+    SDL_SemWait(raster_done);
+}
 
 
-  /* Make the original go away: */
+/* A rasterizer thread: work on its band whenever there's a job: */
 
-  asteroids[j].alive = 0;
+int raster_worker(void *data)
+{
+  int band;
 
+  band = *(int *) data;
 
-  /* Add explosion: */
+  while (1)
+  {
+    SDL_SemWait(raster_go[band]);
 
-  playsound(SND_AST1 + (asteroids[j].size) - 1);
+    if (raster_job == RASTER_QUIT)
+      break;
 
-  for (k = 0; k < exp_size; k++)
-  {
-    add_bit((asteroids[j].x -
-             (asteroids[j].size * AST_RADIUS) +
-             (rand() % (AST_RADIUS * 2))),
-            (asteroids[j].y -
-             (asteroids[j].size * AST_RADIUS) +
-             (rand() % (AST_RADIUS * 2))),
-            ((rand() % (asteroids[j].size * 3)) -
-             (asteroids[j].size) +
-             ((xm + asteroids[j].xm) / 3)),
-            ((rand() % (asteroids[j].size * 3)) -
-             (asteroids[j].size) + ((ym + asteroids[j].ym) / 3)));
+    raster_band(band);
+    SDL_SemPost(raster_done);
   }
+
+  return (0);
 }
 
 
-/* Increment score: */
+/* Do the current job for one band; nothing outside its rows of "screen"
+   (or of coverage) gets touched, so the bands need no locking: */
 
-void add_score(int amount)
+void raster_band(int band)
 {
-  /* See if they deserve a new life: */
+  int i, top, bottom, k0, k1;
+  draw_cmd_type *cmd;
 
-  if (score / ONEUP_SCORE < (score + amount) / ONEUP_SCORE)
+  top = band_top(band);
+  bottom = band_top(band + 1);
+
+  if (raster_job == RASTER_LINES)
+  {
+    for (i = 0; i < num_band_cmds[band]; i++)
+    {
+      cmd = &flush_list->cmds[band_cmds[band][i]];
+
+      if (cmd->kind == DRAW_GLYPH)
+      {
+        blit_glyph(cmd, top, bottom);
+      }
+      else if (cmd->kind == DRAW_SPARKLE)
+      {
+        blit_sparkle(cmd, top, bottom);
+      }
+      else if (cmd->kind == DRAW_BITS)
+      {
+        plot_bits(cmd, top, bottom);
+      }
+      else if (clip_rows(cmd->x1, cmd->y1, cmd->x2, cmd->y2, top, bottom,
+                    &k0, &k1))
+      {
+        if (k0 < cmd->k0)
+          k0 = cmd->k0;
+        if (k1 > cmd->k1)
+          k1 = cmd->k1;
+
+        if (k0 <= k1)
+          rasterize_line(cmd->x1, cmd->y1, cmd->c1, cmd->x2, cmd->y2,
+                         cmd->c2, k0, k1, top, bottom);
+      }
+    }
+  }
+  else if (raster_job == RASTER_SHADOWS)
+  {
+    draw_shadow_rows(top, bottom);
+  }
+}
+
+
+/* Start up the rasterizer threads for "--threads": */
+
+void start_raster_threads(void)
+{
+  int i;
+
+  raster_done = SDL_CreateSemaphore(0);
+
+  for (i = 1; i < num_threads; i++)
+  {
+    raster_band_num[i] = i;
+    raster_go[i] = SDL_CreateSemaphore(0);
+    raster_thread[i] = SDL_CreateThread(raster_worker, "raster",
+                                        &raster_band_num[i]);
+
+    if (raster_go[i] == NULL || raster_thread[i] == NULL)
+    {
+      fprintf(stderr,
+              "\nError: I could not start a rasterizer thread!\n"
+              "The Simple DirectMedia error that occured was:\n"
+              "%s\n\n", SDL_GetError());
+      exit(1);
+    }
+  }
+
+  raster_threads = num_threads;
+}
+
+
+/* ...and shut them down: */
+
+void stop_raster_threads(void)
+{
+  int i;
+
+  raster_job = RASTER_QUIT;
+
+  for (i = 1; i < num_threads; i++)
+  {
+    SDL_SemPost(raster_go[i]);
+    SDL_WaitThread(raster_thread[i], NULL);
+    SDL_DestroySemaphore(raster_go[i]);
+  }
+
+  SDL_DestroySemaphore(raster_done);
+}
+
+
+/* Draw steps k through k1 of a line (see clip()), within rows "top" up to
+   (but not including) "bottom": */
+
+void rasterize_line(int x1, int y1, color_type c1,
+                    int x2, int y2, color_type c2, int k, int k1,
+                    int top_row, int bottom_row)
+{
+  int dx, dy, sx, x, ya, yb, dq, dm, err, top, bot, run_x;
+  shade_type sh, run;
+
+#ifdef EMBEDDED
+  c2 = c1;
+#endif
+
+  dx = x2 - x1;
+  dy = y2 - y1;
+
+  sx = 1;
+  if (dx < 0)
+  {
+    sx = -1;
+    dx = -dx;
+  }
+
+  if (dx == 0)
+  {
+    /* Vertical (or a single dot); k counts rows: */
+
+    mkshade(&sh, c1, c2, dy);
+
+    if (dy >= 0)
+      top = y1 + k;
+    else
+      top = y1 - k1;
+
+    shade_advance(&sh, top - y1);
+    drawvertline(x1, top, k1 - k + 1, &sh);
+
+    return;
+  }
+
+
+  /* Y steps by a floored quotient, plus a carry from the remainder: */
+
+  dq = dy / dx;
+  dm = dy % dx;
+  if (dm < 0)
+  {
+    dq--;
+    dm = dm + dx;
+  }
+
+
+  /* Start at the first column left after clipping: */
+
+  x = x1 + sx * k;
+  ya = y1 + floor_div(k * dy, dx);
+  err = k * dy - (ya - y1) * dx;
+
+  if (abs(dy) > dx)
+  {
+    /* Steep: one vertical run per column, shaded by row: */
+
+    mkshade(&sh, c1, c2, dy);
+
+    for (; k <= k1; k++)
+    {
+      yb = ya + dq;
+      err = err + dm;
+      if (err >= dx)
+      {
+        err = err - dx;
+        yb++;
+      }
+
+      top = ya;
+      bot = yb;
+      if (top > bot)
+      {
+        top = yb;
+        bot = ya;
+      }
+
+      if (top < top_row)
+        top = top_row;
+      if (bot >= bottom_row)
+        bot = bottom_row - 1;
+
+      run = sh;
+      shade_advance(&run, top - y1);
+      drawvertline(x, top, bot - top + 1, &run);
+
+      x = x + sx;
+      ya = yb;
+    }
+  }
+  else
+  {
+    /* Shallow: one horizontal run per row, shaded by column: */
+
+    mkshade(&sh, c1, c2, x2 - x1);
+
+    run_x = x;
+
+    for (; k <= k1; k++)
+    {
+      yb = ya + dq;
+      err = err + dm;
+      if (err >= dx)
+      {
+        err = err - dx;
+        yb++;
+      }
+
+      if (yb != ya)
+      {
+        /* The run ends here; the pixel at (x, yb) starts the next: */
+
+        if (ya >= top_row && ya < bottom_row)
+          drawline_run(run_x, x, ya, x1, &sh);
+
+        run_x = x;
+      }
+
+      x = x + sx;
+      ya = yb;
+    }
+
+    if (ya >= top_row && ya < bottom_row)
+      drawline_run(run_x, x - sx, ya, x1, &sh);
+  }
+}
+
+
+/* Draw one row's run of a shallow line, from column xa to xb: */
+
+void drawline_run(int xa, int xb, int y, int x1, shade_type *sh)
+{
+  int tmp;
+  shade_type run;
+
+  if (xa > xb)
+  {
+    tmp = xa;
+    xa = xb;
+    xb = tmp;
+  }
+
+  run = *sh;
+  shade_advance(&run, xa - x1);
+  drawhorizline(xa, y, xb - xa + 1, &run);
+}
+
+
+/* Set up 8.8 fixed-point shading from c1 to c2 over "steps" pixels
+   (negative if the line runs up or left, so it's always the step to the
+   next pixel down or right).  Steps round toward zero, so a channel
+   never overshoots c2. */
+
+void mkshade(shade_type *sh, color_type c1, color_type c2, int steps)
+{
+  sh->r = c1.r << 8;
+  sh->g = c1.g << 8;
+  sh->b = c1.b << 8;
+
+  sh->rd = 0;
+  sh->gd = 0;
+  sh->bd = 0;
+
+  if (steps != 0)
+  {
+    sh->rd = (c2.r - c1.r) * 256 / steps;
+    sh->gd = (c2.g - c1.g) * 256 / steps;
+    sh->bd = (c2.b - c1.b) * 256 / steps;
+  }
+}
+
+
+/* Move shading along by some number of pixels: */
+
+void shade_advance(shade_type *sh, int steps)
+{
+  sh->r = sh->r + sh->rd * steps;
+  sh->g = sh->g + sh->gd * steps;
+  sh->b = sh->b + sh->bd * steps;
+}
+
+
+/* Clip a line to the window, as the range of steps along it that are
+   visible: k0 through k1 of the columns x1 + k * sx (or, for vertical
+   lines, of the rows y1 + k * sy).  This is parametric clipping with
+   t = k / |dx|, done in integers against the DDA in rasterize_line(), so
+   a clipped line covers exactly the pixels the whole line would. */
+
+int clip(int x1, int y1, int x2, int y2, int *k0, int *k1)
+{
+  /* Entirely on the screen? */
+
+  if (x1 >= 0 && x1 < WIDTH && y1 >= 0 && y1 < HEIGHT &&
+      x2 >= 0 && x2 < WIDTH && y2 >= 0 && y2 < HEIGHT)
+  {
+    *k0 = 0;
+    *k1 = line_steps(x1, y1, x2, y2);
+    return TRUE;
+  }
+
+#ifndef EMBEDDED
+  return (clip_rows(x1, y1, x2, y2, 0, HEIGHT, k0, k1));
+#else
+
+  /* (Not worth the trouble on small devices; skip partly-visible lines) */
+
+  return FALSE;
+
+#endif
+}
+
+
+/* Clip a line (as above) to the screen's columns, and rows "top" up to
+   (but not including) "bottom": */
+
+int clip_rows(int x1, int y1, int x2, int y2, int top, int bottom,
+              int *k0, int *k1)
+{
+  int dx, dy, lo, hi, first, last, n;
+
+  n = line_steps(x1, y1, x2, y2);
+  dx = abs(x2 - x1);
+  dy = y2 - y1;
+
+  if (dx == 0)
+  {
+    /* Vertical: the rows in range: */
+
+    if (x1 < 0 || x1 >= WIDTH)
+      return FALSE;
+
+    if (dy >= 0)
+    {
+      lo = top - y1;
+      hi = bottom - 1 - y1;
+    }
+    else
+    {
+      lo = y1 - (bottom - 1);
+      hi = y1 - top;
+    }
+  }
+  else
+  {
+    /* The columns that are on the screen... */
+
+    if (x2 > x1)
+    {
+      lo = -x1;
+      hi = WIDTH - 1 - x1;
+    }
+    else
+    {
+      lo = x1 - (WIDTH - 1);
+      hi = x1;
+    }
+
+
+    /* ...and that reach a row in range, between Y(k) and Y(k + 1): */
+
+    if (dy > 0)
+    {
+      first = -floor_div((y1 - top) * dx, dy) - 1;
+      last = -floor_div((y1 - bottom) * dx, dy) - 1;
+    }
+    else if (dy < 0)
+    {
+      first = floor_div((y1 - bottom) * dx, -dy);
+      last = floor_div((y1 - top) * dx, -dy);
+    }
+    else if (y1 < top || y1 >= bottom)
+    {
+      return FALSE;
+    }
+    else
+    {
+      first = lo;
+      last = hi;
+    }
+
+    if (first > lo)
+      lo = first;
+    if (last < hi)
+      hi = last;
+  }
+
+  if (lo < 0)
+    lo = 0;
+  if (hi > n)
+    hi = n;
+
+  *k0 = lo;
+  *k1 = hi;
+
+  return (lo <= hi);
+}
+
+
+/* The last step of a whole line (see clip()): */
+
+int line_steps(int x1, int y1, int x2, int y2)
+{
+  if (x1 == x2)
+    return (abs(y2 - y1));
+  else
+    return (abs(x2 - x1) - 1);
+}
+
+
+/* Division rounding toward negative infinity (b > 0): */
+
+int floor_div(int a, int b)
+{
+  if (a >= 0)
+    return (a / b);
+  else
+    return (-((b - 1 - a) / b));
+}
+
+
+/* Draw a verticle line, "n" pixels down from (x, y): */
+
+void drawvertline(int x, int y, int n, shade_type *sh)
+{
+  if (use_indexed)
+    span_shade_index(index_rows[y] + x, n, index_stride, sh);
+  else if (!screen_native)
+    span_putpixels(x, y, n, 0, 1, sh);
+  else
+    span_shade(screen_rows[y] + x, n, screen_stride, sh);
+
+  cover_vert(x, y, n);
+}
+
+
+/* Draw a horizontal line, "n" pixels right from (x, y): */
+
+void drawhorizline(int x, int y, int n, shade_type *sh)
+{
+  if (use_indexed)
+    span_shade_index(index_rows[y] + x, n, 1, sh);
+  else if (!screen_native)
+    span_putpixels(x, y, n, 1, 0, sh);
+  else
+    span_shade(screen_rows[y] + x, n, 1, sh);
+
+  cover_horiz(x, y, n);
+}
+
+
+/* Draw a run of pixels one at a time, for when "screen" isn't in the
+   format the span kernels expect: */
+
+void span_putpixels(int x, int y, int n, int stepx, int stepy,
+                    shade_type *sh)
+{
+  int i, r, g, b;
+
+  r = sh->r;
+  g = sh->g;
+  b = sh->b;
+
+  for (i = 0; i < n; i++)
+  {
+    putpixel(screen, x, y, SDL_MapRGB(screen->format,
+                                      r >> 8, g >> 8, b >> 8));
+
+    x = x + stepx;
+    y = y + stepy;
+
+    r = r + sh->rd;
+    g = g + sh->gd;
+    b = b + sh->bd;
+  }
+}
+
+
+/* Forget last frame's coverage, a row at a time: */
+
+void clear_coverage(void)
+{
+  int y;
+
+  for (y = 0; y < HEIGHT; y++)
+  {
+    if (coverage_row_used[y])
+    {
+      memset(coverage[y] + coverage_lo[y], 0,
+             (coverage_hi[y] - coverage_lo[y] + 1) * sizeof(Uint32));
+      coverage_row_used[y] = 0;
+    }
+  }
+}
+
+
+/* Note that words lo through hi of a row are getting drawn on: */
+
+void cover_row(int y, int lo, int hi)
+{
+  if (!coverage_row_used[y])
+  {
+    coverage_row_used[y] = 1;
+
+    coverage_lo[y] = lo;
+    coverage_hi[y] = hi;
+  }
+  else
+  {
+    if (lo < coverage_lo[y])
+      coverage_lo[y] = lo;
+    if (hi > coverage_hi[y])
+      coverage_hi[y] = hi;
+  }
+}
+
+
+/* Mark "n" pixels down from (x, y) as covered: */
+
+void cover_vert(int x, int y, int n)
+{
+  Uint32 bit;
+
+  bit = (Uint32) 1 << (x & 31);
+  x = x >> 5;
+
+  for (; n > 0; n--)
+  {
+    cover_row(y, x, x);
+
+    coverage[y][x] = coverage[y][x] | bit;
+    y++;
+  }
+}
+
+
+/* Mark "n" pixels right from (x, y) as covered: */
+
+void cover_horiz(int x, int y, int n)
+{
+  int w, last;
+  Uint32 *row;
+
+  last = x + n - 1;
+  cover_row(y, x >> 5, last >> 5);
+
+  row = coverage[y];
+
+  if ((x >> 5) == (last >> 5))
+  {
+    row[x >> 5] |= ((Uint32) 0xFFFFFFFF >> (31 - (last - x))) << (x & 31);
+  }
+  else
+  {
+    row[x >> 5] |= (Uint32) 0xFFFFFFFF << (x & 31);
+
+    for (w = (x >> 5) + 1; w < (last >> 5); w++)
+      row[w] = 0xFFFFFFFF;
+
+    row[last >> 5] |= (Uint32) 0xFFFFFFFF >> (31 - (last & 31));
+  }
+}
+
+
+/* Drop shadows: black, down and to the right of every covered pixel,
+   wherever that isn't covered itself.  Done once a frame, after all the
+   lines, so it doesn't matter what order they were drawn in: */
+
+void draw_shadows(void)
+{
+  if (raster_threads <= 1)
+    draw_shadow_rows(raster_top, raster_bottom);
+  else
+    run_raster_job(RASTER_SHADOWS);
+}
+
+
+/* Draw the shadows in rows "top" up to (but not including) "bottom": */
+
+void draw_shadow_rows(int top, int bottom)
+{
+  int y, w, x, lo, hi;
+  Uint32 mask[MAX_COVERAGE_WORDS], bits;
+
+  for (y = (top > 0 ? top : 1); y < bottom; y++)
+  {
+    if (!coverage_row_used[y - 1])
+      continue;
+
+
+    /* (The row above's words, and the one its last bit shifts into) */
+
+    lo = coverage_lo[y - 1];
+    hi = coverage_hi[y - 1] + 1;
+
+    if (hi >= COVERAGE_WORDS)
+      hi = COVERAGE_WORDS - 1;
+
+    shadow_row_mask(mask, coverage[y - 1] + lo, coverage[y] + lo,
+                    hi - lo + 1);
+
+    /* (Nothing past the right edge) */
+
+    if (hi == COVERAGE_WORDS - 1)
+      mask[hi - lo] = mask[hi - lo] & ((Uint32) 0xFFFFFFFF >>
+                                       ((32 - WIDTH % 32) % 32));
+
+    for (w = lo; w <= hi; w++)
+    {
+      bits = mask[w - lo];
+
+      while (bits != 0)
+      {
+        /* (Lowest set bit's position, by de Bruijn sequence) */
+
+        x = w * 32 + bit_position[((bits & (0 - bits)) * 0x077CB531) >> 27];
+        bits = bits & (bits - 1);
+
+        if (use_indexed)
+          index_rows[y][x] = shadow_index;
+        else if (screen_native)
+          screen_rows[y][x] = shadow_pixel;
+        else
+          putpixel(screen, x, y, shadow_pixel);
+      }
+    }
+  }
+}
+
+
+/* Work out which pixels of "n" words of a row get a shadow: the row
+   above's coverage, shifted one pixel right, less the row's own.  (The
+   word before "above" must be empty.) */
+
+void shadow_row_mask(Uint32 *mask, Uint32 *above, Uint32 *row, int n)
+{
+  int i;
+  Uint32 carry;
+#if defined(__SSE2__)
+  __m128i a, prev;
+#elif defined(__ARM_NEON)
+  uint32x4_t a, prev;
+#endif
+
+  carry = 0;
+  i = 0;
+
+#if defined(__SSE2__)
+  for (; i + 4 <= n; i = i + 4)
+  {
+    /* (Each word picks up the top bit of the word before it) */
+
+    a = _mm_loadu_si128((__m128i *) (above + i));
+    prev = _mm_or_si128(_mm_slli_si128(a, 4), _mm_cvtsi32_si128(carry));
+    a = _mm_or_si128(_mm_slli_epi32(a, 1), _mm_srli_epi32(prev, 31));
+    a = _mm_andnot_si128(_mm_loadu_si128((__m128i *) (row + i)), a);
+    _mm_storeu_si128((__m128i *) (mask + i), a);
+
+    carry = above[i + 3];
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 4 <= n; i = i + 4)
+  {
+    a = vld1q_u32(above + i);
+    prev = vextq_u32(vdupq_n_u32(carry), a, 3);
+    a = vorrq_u32(vshlq_n_u32(a, 1), vshrq_n_u32(prev, 31));
+    vst1q_u32(mask + i, vbicq_u32(a, vld1q_u32(row + i)));
+
+    carry = above[i + 3];
+  }
+#endif
+
+  for (; i < n; i++)
+  {
+    mask[i] = ((above[i] << 1) | (carry >> 31)) & ~row[i];
+    carry = above[i];
+  }
+}
+
+
+/* For "--zero-copy": draw a display list straight into the screen
+   texture.  SDL only promises that locked pixels can be written, not that
+   they still hold the last frame, so each run of dirty bands (see
+   DIRTY_ROWS) that's drawn on now, or was last time, is locked, made
+   see-through, and drawn afresh, in turn.  The rest of the texture is
+   left as it was (see-through), and isn't sent again: */
+
+void draw_locked_bands(draw_list_type * list)
+{
+  int i, b, b2, top, bottom;
+  Uint32 tiles[MAX_DIRTY_BANDS];
+  draw_cmd_type *cmd;
+
+  for (b = 0; b < NUM_DIRTY_BANDS; b++)
+    tiles[b] = 0;
+
+  for (i = 0; i < list->num_cmds; i++)
+  {
+    cmd = &list->cmds[i];
+
+    top = cmd->y1;
+    bottom = cmd->y2;
+    if (top > bottom)
+    {
+      top = cmd->y2;
+      bottom = cmd->y1;
+    }
+
+
+    /* (Its shadow lands on the row below) */
+
+    bottom++;
+
+    if (bottom < 0 || top >= HEIGHT)
+      continue;
+
+    if (top < 0)
+      top = 0;
+    if (bottom >= HEIGHT)
+      bottom = HEIGHT - 1;
+
+    for (b = top / DIRTY_ROWS; b <= bottom / DIRTY_ROWS; b++)
+      tiles[b] = DIRTY_ALL;
+  }
+
+  clear_coverage();
+
+  b = 0;
+
+  while (b < NUM_DIRTY_BANDS)
+  {
+    if (tiles[b] == 0 && drawn_tiles[b] == 0)
+    {
+      b++;
+    }
+    else
+    {
+      for (b2 = b + 1; b2 < NUM_DIRTY_BANDS; b2++)
+        if (tiles[b2] == 0 && drawn_tiles[b2] == 0)
+          break;
+
+      raster_top = b * DIRTY_ROWS;
+      raster_bottom = b2 * DIRTY_ROWS;
+      if (raster_bottom > HEIGHT)
+        raster_bottom = HEIGHT;
+
+      lock_screen();
+      rasterize_list(list);
+      draw_shadows();
+      unlock_screen();
+
+      b = b2;
+    }
+  }
+
+  raster_top = 0;
+  raster_bottom = HEIGHT;
+
+  for (b = 0; b < NUM_DIRTY_BANDS; b++)
+    drawn_tiles[b] = tiles[b];
+
+  list->num_cmds = 0;
+  list->num_bit_segs = 0;
+}
+
+
+/* Lock the rows being drawn (see draw_locked_bands()), point them at the
+   screen texture's own memory, and clear them.  (The other rows stay
+   pointed at "screen"; nothing is drawn on them) */
+
+void lock_screen(void)
+{
+  void *pixels;
+  int pitch, y;
+  SDL_Rect r;
+
+  r.x = 0;
+  r.y = raster_top;
+  r.w = WIDTH;
+  r.h = raster_bottom - raster_top;
+
+  if (SDL_LockTexture(screenTexture, &r, &pixels, &pitch) < 0)
+  {
+    fprintf(stderr,
+            "\nError: I couldn't lock the screen texture!\n"
+            "The Simple DirectMedia error that occured was:\n"
+            "%s\n\n", SDL_GetError());
+    exit(1);
+  }
+
+  for (y = raster_top; y < raster_bottom; y++)
+  {
+    screen_rows[y] = (pixel_type *) ((Uint8 *) pixels +
+                                     (y - raster_top) * pitch);
+    memset(screen_rows[y], 0, WIDTH * sizeof(pixel_type));
+  }
+
+  screen_stride = pitch / sizeof(pixel_type);
+
+  bench_copied = bench_copied + r.w * r.h * sizeof(pixel_type);
+}
+
+
+/* ...and hand them back (SDL takes it from there), returning the rows to
+   "screen": */
+
+void unlock_screen(void)
+{
+  SDL_UnlockTexture(screenTexture);
+  setup_screen_rows();
+
+  bench_uploaded = bench_uploaded + WIDTH * (raster_bottom - raster_top);
+  bench_copied = bench_copied + WIDTH * (raster_bottom - raster_top) *
+    sizeof(pixel_type);
+}
+
+
+/* With "--renderer=sdl", nothing's rasterized here:  each frame's display
+   list is turned into quads (one pixel wide, for lines, shaded from end to
+   end) and handed to SDL_RenderGeometry(), to draw over the background
+   texture.  Two triangles a quad, so their indices never change: */
+
+void setup_quads(void)
+{
+  int i;
+
+  for (i = 0; i < MAX_QUADS; i++)
+  {
+    quad_indices[i * 6 + 0] = i * 4 + 0;
+    quad_indices[i * 6 + 1] = i * 4 + 1;
+    quad_indices[i * 6 + 2] = i * 4 + 2;
+    quad_indices[i * 6 + 3] = i * 4 + 2;
+    quad_indices[i * 6 + 4] = i * 4 + 1;
+    quad_indices[i * 6 + 5] = i * 4 + 3;
+  }
+
+  num_quads = 0;
+}
+
+
+/* Draw a display list through the renderer (the shadows first, so they go
+   under everything), and empty it: */
+
+void render_draw_cmds(draw_list_type * list)
+{
+  quads_for_cmds(list, TRUE);
+  quads_for_cmds(list, FALSE);
+  flush_quads();
+
+  list->num_cmds = 0;
+  list->num_bit_segs = 0;
+}
+
+
+/* Turn every command on a list into quads (or, if "shadow", the quads of
+   their drop shadows): */
+
+void quads_for_cmds(draw_list_type * list, int shadow)
+{
+  int i, j, x, y, nx, ny, xs[3], ys[3];
+  Uint8 r, g8, b;
+  draw_cmd_type *cmd;
+  glyph_type *g;
+  glyph_run_type *run;
+  sparkle_type *sp;
+  bit_seg_type *seg;
+
+  for (i = 0; i < list->num_cmds; i++)
+  {
+    cmd = &list->cmds[i];
+
+    if (cmd->kind == DRAW_GLYPH)
+    {
+      g = &glyphs[cmd->k0][cmd->k1];
+
+      for (j = 0; j < g->num_runs; j++)
+      {
+        run = &glyph_runs[g->first + j];
+        quad_rect(cmd->x1 + run->x, cmd->y1 + run->y, run->w, run->h,
+                  cmd->c1, shadow);
+      }
+    }
+    else if (cmd->kind == DRAW_SPARKLE)
+    {
+      sp = &sparkles[cmd->k0];
+
+      for (y = 0; y < SPARKLE_SIZE; y++)
+      {
+        for (x = 0; x < SPARKLE_SIZE; x++)
+        {
+          if (sp->mask[y] & (1 << x))
+          {
+            SDL_GetRGB(sp->pixels[y][x], screen->format, &r, &g8, &b);
+            quad_rect(cmd->x1 + x, cmd->y1 + y, 1, 1, mkcolor(r, g8, b),
+                      shadow);
+          }
+        }
+      }
+    }
+    else if (cmd->kind == DRAW_BITS)
+    {
+      for (j = cmd->k0; j < cmd->k0 + cmd->k1; j++)
+      {
+        seg = &list->bit_segs[j];
+
+        /* (Each copy of it that wraps onto the screen) */
+
+        nx = wrap_offsets(seg->x, seg->x + seg->xm, WIDTH, xs);
+        ny = wrap_offsets(seg->y, seg->y + seg->ym, HEIGHT, ys);
+
+        for (y = 0; y < ny; y++)
+        {
+          for (x = 0; x < nx; x++)
+          {
+            quad_line(seg->x + xs[x], seg->y + ys[y], cmd->c1,
+                      seg->x + seg->xm + xs[x], seg->y + seg->ym + ys[y],
+                      cmd->c1, shadow);
+          }
+        }
+      }
+    }
+    else
+    {
+      quad_line(cmd->x1, cmd->y1, cmd->c1, cmd->x2, cmd->y2, cmd->c2,
+                shadow);
+    }
+  }
+}
+
+
+/* A line's quad: one pixel across, along the pixels rasterize_line()
+   would draw (including the far end, if it's vertical): */
+
+void quad_line(int x1, int y1, color_type c1, int x2, int y2, color_type c2,
+               int shadow)
+{
+#ifdef EMBEDDED
+  c2 = c1;
+#endif
+
+  if (x1 == x2)
+  {
+    if (y2 >= y1)
+      add_quad(x1 + 0.5, y1, x2 + 0.5, y2 + 1, 0.5, 0, c1, c2, shadow);
+    else
+      add_quad(x1 + 0.5, y1 + 1, x2 + 0.5, y2, 0.5, 0, c1, c2, shadow);
+  }
+  else if (abs(y2 - y1) > abs(x2 - x1))
+  {
+    add_quad(x1 + 0.5, y1 + 0.5, x2 + 0.5, y2 + 0.5, 0.5, 0, c1, c2,
+             shadow);
+  }
+  else
+  {
+    add_quad(x1 + 0.5, y1 + 0.5, x2 + 0.5, y2 + 0.5, 0, 0.5, c1, c2,
+             shadow);
+  }
+}
+
+
+/* A solid rectangle's quad: */
+
+void quad_rect(int x, int y, int w, int h, color_type c, int shadow)
+{
+  add_quad(x, y + h / 2.0, x + w, y + h / 2.0, 0, h / 2.0, c, c, shadow);
+}
+
+
+/* Add a quad, from point "a" to point "b", reaching (nx, ny) to either
+   side, shaded from color "ca" to "cb" (or black and a pixel down and to
+   the right, for a shadow): */
+
+void add_quad(float xa, float ya, float xb, float yb, float nx, float ny,
+              color_type ca, color_type cb, int shadow)
+{
+#ifdef RENDER_GEOMETRY
+  int i;
+  SDL_Vertex *v;
+
+  if (num_quads >= MAX_QUADS)
+    flush_quads();
+
+  v = &quad_verts[num_quads * 4];
+
+  v[0].position.x = xa - nx;
+  v[0].position.y = ya - ny;
+  v[1].position.x = xa + nx;
+  v[1].position.y = ya + ny;
+  v[2].position.x = xb - nx;
+  v[2].position.y = yb - ny;
+  v[3].position.x = xb + nx;
+  v[3].position.y = yb + ny;
+
+  for (i = 0; i < 4; i++)
+  {
+    if (shadow)
+    {
+      v[i].position.x = v[i].position.x + 1;
+      v[i].position.y = v[i].position.y + 1;
+      v[i].color.r = 0;
+      v[i].color.g = 0;
+      v[i].color.b = 0;
+    }
+    else
+    {
+      v[i].color.r = (i < 2 ? ca.r : cb.r);
+      v[i].color.g = (i < 2 ? ca.g : cb.g);
+      v[i].color.b = (i < 2 ? ca.b : cb.b);
+    }
+
+    v[i].color.a = 255;
+    v[i].tex_coord.x = 0;
+    v[i].tex_coord.y = 0;
+  }
+
+  num_quads++;
+#endif
+}
+
+
+/* Draw the quads so far: */
+
+void flush_quads(void)
+{
+#ifdef RENDER_GEOMETRY
+  if (num_quads > 0 &&
+      SDL_RenderGeometry(renderer, NULL, quad_verts, num_quads * 4,
+                         quad_indices, num_quads * 6) < 0)
+  {
+    fprintf(stderr,
+            "\nError: I couldn't draw with the SDL renderer!\n"
+            "The Simple DirectMedia error that occured was:\n"
+            "%s\n\n", SDL_GetError());
+    exit(1);
+  }
+#endif
+
+  num_quads = 0;
+}
+
+
+/* Make the dirty tile columns as few coverage words wide as they can be,
+   while still fitting a band's worth of them in 32 bits: */
+
+void setup_dirty_tiles(void)
+{
+  dirty_shift = 0;
+
+  while ((COVERAGE_WORDS + DIRTY_COLUMN_WORDS - 1) >> dirty_shift > 32)
+    dirty_shift++;
+
+  dirty_columns = (COVERAGE_WORDS + DIRTY_COLUMN_WORDS - 1) >> dirty_shift;
+}
+
+
+/* Work out which tiles this frame drew on (lines and their shadows), from
+   its coverage: */
+
+void mark_dirty_tiles(Uint32 *tiles)
+{
+  int b, y, w;
+  Uint32 bits;
+
+  for (b = 0; b < NUM_DIRTY_BANDS; b++)
+    tiles[b] = 0;
+
+  for (y = 0; y < HEIGHT; y++)
+  {
+    if (coverage_row_used[y])
+    {
+      bits = 0;
+
+      for (w = coverage_lo[y]; w <= coverage_hi[y]; w++)
+      {
+        if (coverage[y][w] != 0)
+        {
+          bits = bits | ((Uint32) 1 << (w >> dirty_shift));
+
+
+          /* (A shadow off a word's last pixel lands in the next word) */
+
+          if ((coverage[y][w] & 0x80000000) && w + 1 < COVERAGE_WORDS)
+            bits = bits | ((Uint32) 1 << ((w + 1) >> dirty_shift));
+        }
+      }
+
+
+      /* (...and shadows land on the row below, too) */
+
+      tiles[y / DIRTY_ROWS] |= bits;
+
+      if (y + 1 < HEIGHT)
+        tiles[(y + 1) / DIRTY_ROWS] |= bits;
+    }
+  }
+
+  for (b = 0; b < NUM_DIRTY_BANDS; b++)
+    tiles[b] = tiles[b] & DIRTY_ALL;
+}
+
+
+/* Turn dirty tiles into rectangles (in "dirty_rects"), one per run of
+   tiles in a band, stretched down over the bands below wherever they have
+   the very same run.  Returns how many, or -1 if it'd be better to just do
+   the whole screen: */
+
+int dirty_tiles_to_rects(Uint32 *tiles)
+{
+  int n, b, i, x0, x1, area;
+  Uint32 t;
+  SDL_Rect r;
+
+  n = 0;
+  area = 0;
+
+  for (b = 0; b < NUM_DIRTY_BANDS; b++)
+  {
+    t = tiles[b];
+    x0 = 0;
+
+    while (t != 0)
+    {
+      /* Find the next run of dirty tiles: */
+
+      while ((t & 1) == 0)
+      {
+        t = t >> 1;
+        x0++;
+      }
+
+      x1 = x0;
+
+      while ((t & 1) != 0)
+      {
+        t = t >> 1;
+        x1++;
+      }
+
+      r.x = x0 * DIRTY_COLUMN_WORDS * 32;
+      r.w = x1 * DIRTY_COLUMN_WORDS * 32;
+      if (r.w > WIDTH)
+        r.w = WIDTH;
+      r.w = r.w - r.x;
+
+      r.y = b * DIRTY_ROWS;
+      r.h = DIRTY_ROWS;
+      if (r.y + r.h > HEIGHT)
+        r.h = HEIGHT - r.y;
+
+      area = area + r.w * r.h;
+
+
+      /* Extend a rectangle from the band above, or start a new one: */
+
+      for (i = 0; i < n; i++)
+      {
+        if (dirty_rects[i].x == r.x && dirty_rects[i].w == r.w &&
+            dirty_rects[i].y + dirty_rects[i].h == r.y)
+        {
+          dirty_rects[i].h = dirty_rects[i].h + r.h;
+          break;
+        }
+      }
+
+      if (i == n)
+      {
+        if (n == MAX_DIRTY_RECTS)
+          return (-1);
+
+        dirty_rects[n++] = r;
+      }
+
+      x0 = x1;
+    }
+  }
+
+  if (area * 100 > WIDTH * HEIGHT * DIRTY_FULL_PERCENT)
+    return (-1);
+
+  return (n);
+}
+
+
+/* Erase whatever the last frame drew, by putting the background back: */
+
+void erase_drawn_tiles(void)
+{
+  int i, n;
+  SDL_Rect r;
+
+  n = dirty_tiles_to_rects(drawn_tiles);
+
+  if (use_indexed)
+  {
+    /* (Just clear the indices; the background comes back on upload) */
+
+    if (n < 0)
+    {
+      SDL_FillRect(index_screen, NULL, 0);
+      bench_copied = bench_copied + WIDTH * HEIGHT;
+    }
+    else
+    {
+      for (i = 0; i < n; i++)
+      {
+        SDL_FillRect(index_screen, &dirty_rects[i], 0);
+        bench_copied = bench_copied + dirty_rects[i].w * dirty_rects[i].h;
+      }
+    }
+  }
+  else if (n < 0)
+  {
+    SDL_BlitSurface(bkgd, NULL, screen, NULL);
+    bench_copied = bench_copied + WIDTH * HEIGHT * sizeof(pixel_type);
+  }
+  else
+  {
+    for (i = 0; i < n; i++)
+    {
+      r = dirty_rects[i];
+      SDL_BlitSurface(bkgd, &dirty_rects[i], screen, &r);
+
+      bench_copied = bench_copied + r.w * r.h * sizeof(pixel_type);
+    }
+  }
+}
+
+
+/* Upload what this frame drew, along with what it erased, to the screen
+   texture: */
+
+void upload_dirty_tiles(void)
+{
+  int i, n, b;
+  Uint32 tiles[MAX_DIRTY_BANDS], changed[MAX_DIRTY_BANDS];
+  SDL_Rect *r, all;
+
+  mark_dirty_tiles(tiles);
+
+  for (b = 0; b < NUM_DIRTY_BANDS; b++)
+  {
+    changed[b] = tiles[b] | drawn_tiles[b];
+    drawn_tiles[b] = tiles[b];
+  }
+
+  n = dirty_tiles_to_rects(changed);
+
+  if (n < 0 && use_indexed)
+  {
+    all.x = 0;
+    all.y = 0;
+    all.w = WIDTH;
+    all.h = HEIGHT;
+
+    expand_index_rect(&all, index_bkgd);
+    bench_uploaded = bench_uploaded + WIDTH * HEIGHT;
+    bench_copied = bench_copied + WIDTH * HEIGHT * sizeof(pixel_type);
+  }
+  else if (n < 0)
+  {
+    SDL_UpdateTexture(screenTexture, NULL, screen->pixels, screen->pitch);
+    bench_uploaded = bench_uploaded + WIDTH * HEIGHT;
+    bench_copied = bench_copied + WIDTH * HEIGHT * sizeof(pixel_type);
+  }
+  else
+  {
+    for (i = 0; i < n; i++)
+    {
+      r = &dirty_rects[i];
+
+      if (use_indexed)
+        expand_index_rect(r, index_bkgd);
+      else
+        SDL_UpdateTexture(screenTexture, r,
+                          (Uint8 *) screen->pixels + r->y * screen->pitch +
+                          r->x * screen->format->BytesPerPixel,
+                          screen->pitch);
+
+      bench_uploaded = bench_uploaded + r->w * r->h;
+      bench_copied = bench_copied + r->w * r->h * sizeof(pixel_type);
+    }
+  }
+}
+
+
+/* Span kernels: write "n" pixels in the screen's own format (see
+   pixel_type), each "stride" pixels after the last: */
+
+/* (A single color, at memset speed where the span is contiguous) */
+
+void span_fill(pixel_type *p, int n, int stride, pixel_type pixel)
+{
+  if (stride == 1)
+  {
+#ifndef EMBEDDED
+    SDL_memset4(p, pixel, n);
+#else
+    while (n > 0)
+    {
+      *p = pixel;
+      p++;
+      n--;
+    }
+#endif
+  }
+  else
+  {
+    while (n > 0)
+    {
+      *p = pixel;
+      p = p + stride;
+      n--;
+    }
+  }
+}
+
+
+/* (Shaded, four pixels at a time with SSE2 or NEON where available; on
+   EMBEDDED, lines are a single color, so this only ever fills) */
+
+void span_shade(pixel_type *p, int n, int stride, shade_type *sh)
+{
+  int r, g, b, rd, gd, bd;
+#if defined(__SSE2__) && !defined(EMBEDDED)
+  __m128i v0, v1, inc, out;
+#elif defined(__ARM_NEON) && SDL_BYTEORDER == SDL_LIL_ENDIAN && \
+  !defined(EMBEDDED)
+  uint16x8_t v0, v1, inc;
+  uint8x16_t out;
+  Uint16 lanes[8];
+  Uint32 quad[4];
+#endif
+
+  r = sh->r;
+  g = sh->g;
+  b = sh->b;
+
+  rd = sh->rd;
+  gd = sh->gd;
+  bd = sh->bd;
+
+  if (n == 1 || (rd == 0 && gd == 0 && bd == 0))
+  {
+    span_fill(p, n, stride, PIXEL(r >> 8, g >> 8, b >> 8));
+    return;
+  }
+
+#if defined(__SSE2__) && !defined(EMBEDDED)
+  if (n >= 4)
+  {
+    /* Two pixels per register, as 16-bit B, G, R, A lanes; the adds
+       wrap, but every lane's true value stays within 0..0xFFFF: */
+
+    v0 = _mm_setr_epi16((short) b, (short) g, (short) r, (short) 0xFF00,
+                        (short) (b + bd), (short) (g + gd), (short) (r + rd),
+                        (short) 0xFF00);
+    inc = _mm_setr_epi16((short) (bd * 2), (short) (gd * 2), (short) (rd * 2),
+                         0, (short) (bd * 2), (short) (gd * 2),
+                         (short) (rd * 2), 0);
+    v1 = _mm_add_epi16(v0, inc);
+    inc = _mm_add_epi16(inc, inc);
+
+    while (n >= 4)
+    {
+      out = _mm_packus_epi16(_mm_srli_epi16(v0, 8), _mm_srli_epi16(v1, 8));
+
+      if (stride == 1)
+      {
+        _mm_storeu_si128((__m128i *) p, out);
+      }
+      else
+      {
+        p[0] = _mm_cvtsi128_si32(out);
+        p[stride] = _mm_cvtsi128_si32(_mm_srli_si128(out, 4));
+        p[stride * 2] = _mm_cvtsi128_si32(_mm_srli_si128(out, 8));
+        p[stride * 3] = _mm_cvtsi128_si32(_mm_srli_si128(out, 12));
+      }
+
+      p = p + stride * 4;
+      n = n - 4;
+
+      v0 = _mm_add_epi16(v0, inc);
+      v1 = _mm_add_epi16(v1, inc);
+    }
+
+    b = (Uint16) _mm_extract_epi16(v0, 0);
+    g = (Uint16) _mm_extract_epi16(v0, 1);
+    r = (Uint16) _mm_extract_epi16(v0, 2);
+  }
+#elif defined(__ARM_NEON) && SDL_BYTEORDER == SDL_LIL_ENDIAN && \
+  !defined(EMBEDDED)
+  if (n >= 4)
+  {
+    lanes[0] = b;
+    lanes[1] = g;
+    lanes[2] = r;
+    lanes[3] = 0xFF00;
+    lanes[4] = b + bd;
+    lanes[5] = g + gd;
+    lanes[6] = r + rd;
+    lanes[7] = 0xFF00;
+    v0 = vld1q_u16(lanes);
+
+    lanes[0] = lanes[4] = bd * 2;
+    lanes[1] = lanes[5] = gd * 2;
+    lanes[2] = lanes[6] = rd * 2;
+    lanes[3] = lanes[7] = 0;
+    inc = vld1q_u16(lanes);
+    v1 = vaddq_u16(v0, inc);
+    inc = vaddq_u16(inc, inc);
+
+    while (n >= 4)
+    {
+      out = vcombine_u8(vshrn_n_u16(v0, 8), vshrn_n_u16(v1, 8));
+
+      if (stride == 1)
+      {
+        vst1q_u8((uint8_t *) p, out);
+      }
+      else
+      {
+        vst1q_u8((uint8_t *) quad, out);
+        p[0] = quad[0];
+        p[stride] = quad[1];
+        p[stride * 2] = quad[2];
+        p[stride * 3] = quad[3];
+      }
+
+      p = p + stride * 4;
+      n = n - 4;
+
+      v0 = vaddq_u16(v0, inc);
+      v1 = vaddq_u16(v1, inc);
+    }
+
+    b = vgetq_lane_u16(v0, 0);
+    g = vgetq_lane_u16(v0, 1);
+    r = vgetq_lane_u16(v0, 2);
+  }
+#endif
+
+  while (n > 0)
+  {
+    *p = PIXEL(r >> 8, g >> 8, b >> 8);
+
+    p = p + stride;
+    n--;
+
+    r = r + rd;
+    g = g + gd;
+    b = b + bd;
+  }
+}
+
+
+/* With "--indexed", lines are drawn as one-byte palette indices instead
+   (see build_palette()), each color quantized through a table of the
+   nearest palette entry to every 15-bit color: */
+
+#define COLOR_INDEX(r, g, b) (color_index[(r) >> 3][(g) >> 3][(b) >> 3])
+
+/* (A single color) */
+
+void span_fill_index(Uint8 *p, int n, int stride, Uint8 index)
+{
+  if (stride == 1)
+  {
+    memset(p, index, n);
+  }
+  else
+  {
+    while (n > 0)
+    {
+      *p = index;
+      p = p + stride;
+      n--;
+    }
+  }
+}
+
+
+/* (Shaded, so each pixel steps along the palette's nearest ramp) */
+
+void span_shade_index(Uint8 *p, int n, int stride, shade_type *sh)
+{
+  int r, g, b;
+
+  r = sh->r;
+  g = sh->g;
+  b = sh->b;
+
+  if (n == 1 || (sh->rd == 0 && sh->gd == 0 && sh->bd == 0))
+  {
+    span_fill_index(p, n, stride, COLOR_INDEX(r >> 8, g >> 8, b >> 8));
+    return;
+  }
+
+  while (n > 0)
+  {
+    *p = COLOR_INDEX(r >> 8, g >> 8, b >> 8);
+
+    p = p + stride;
+    n--;
+
+    r = r + sh->rd;
+    g = g + sh->gd;
+    b = b + sh->bd;
+  }
+}
+
+
+/* Expand a rectangle of "index_screen" into the screen texture, showing
+   "bg" (or black, if it's NULL) wherever nothing was drawn: */
+
+void expand_index_rect(SDL_Rect *r, SDL_Surface *bg)
+{
+  int y, pitch;
+  void *pixels;
+  pixel_type *bg_row;
+
+  if (SDL_LockTexture(screenTexture, r, &pixels, &pitch) < 0)
+  {
+    fprintf(stderr,
+            "\nError: I couldn't lock the screen texture!\n"
+            "The Simple DirectMedia error that occured was:\n"
+            "%s\n\n", SDL_GetError());
+    exit(1);
+  }
+
+  bg_row = NULL;
+
+  for (y = 0; y < r->h; y++)
+  {
+    if (bg != NULL)
+      bg_row = (pixel_type *) ((Uint8 *) bg->pixels +
+                               (r->y + y) * bg->pitch) + r->x;
+
+    expand_index_span((pixel_type *) ((Uint8 *) pixels + y * pitch),
+                      index_rows[r->y + y] + r->x, bg_row, r->w);
+  }
+
+  SDL_UnlockTexture(screenTexture);
+}
+
+
+/* Expand "n" palette indices into screen pixels; index 0 is see-through.
+   Most of the screen is, so sixteen pixels at a time get the background
+   copied in, and SSE2 or NEON only finds which (if any) were drawn on;
+   those are looked up in "palette" one at a time.  (Neither has a gather
+   to look up several at once, and there are rarely more than a few) */
+
+void expand_index_span(pixel_type *dst, Uint8 *src, pixel_type *bg, int n)
+{
+  int i, j;
+#if defined(__SSE2__)
+  Uint32 bits;
+  __m128i zero, idx;
+#elif defined(__ARM_NEON)
+  uint64x2_t idx;
+#endif
+
+  i = 0;
+
+#if defined(__SSE2__)
+  zero = _mm_setzero_si128();
+#endif
+
+  for (; i + 16 <= n; i = i + 16)
+  {
+    if (bg != NULL)
+      memcpy(dst + i, bg + i, 16 * sizeof(pixel_type));
+    else
+      span_fill(dst + i, 16, 1, PIXEL(0, 0, 0));
+
+#if defined(__SSE2__)
+    idx = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *) (src + i)), zero);
+    bits = ~_mm_movemask_epi8(idx) & 0xFFFF;
+
+    while (bits != 0)
+    {
+      /* (Lowest set bit's position, by de Bruijn sequence) */
+
+      j = i + bit_position[((bits & (0 - bits)) * 0x077CB531) >> 27];
+      bits = bits & (bits - 1);
+
+      dst[j] = palette[src[j]];
+    }
+#else
+#if defined(__ARM_NEON)
+    idx = vreinterpretq_u64_u8(vld1q_u8(src + i));
+
+    if ((vgetq_lane_u64(idx, 0) | vgetq_lane_u64(idx, 1)) == 0)
+      continue;
+#endif
+
+    for (j = i; j < i + 16; j++)
+    {
+      if (src[j] != 0)
+        dst[j] = palette[src[j]];
+    }
+#endif
+  }
+
+  for (; i < n; i++)
+    dst[i] = (src[i] != 0 ? palette[src[i]] :
+              (bg != NULL ? bg[i] : PIXEL(0, 0, 0)));
+}
+
+
+/* Draw a single pixel into the surface: */
+
+void putpixel(SDL_Surface *surface, int x, int y, Uint32 pixel)
+{
+  int bpp;
+  Uint8 *p;
+
+
+  /* Assuming the X/Y values are within the bounds of this surface... */
+
+  if (x >= 0 && y >= 0 && x < WIDTH && y < HEIGHT)
+  {
+    /* Determine bytes-per-pixel for the surface in question: */
+
+    bpp = surface->format->BytesPerPixel;
+
+
+    /* Set a pointer to the exact location in memory of the pixel
+       in question: */
+
+    p = (((Uint8 *) surface->pixels) +  /* Start at beginning of RAM */
+         (y * surface->pitch) + /* Go down Y lines */
+         (x * bpp));            /* Go in X pixels */
+
+
+    /* Set the (correctly-sized) piece of data in the surface's RAM
+       to the pixel value sent in: */
+
+    if (bpp == 1)
+      *p = pixel;
+    else if (bpp == 2)
+      *(Uint16 *) p = pixel;
+    else if (bpp == 3)
+    {
+      if (SDL_BYTEORDER == SDL_BIG_ENDIAN)
+      {
+        p[0] = (pixel >> 16) & 0xff;
+        p[1] = (pixel >> 8) & 0xff;
+        p[2] = pixel & 0xff;
+      }
+      else
+      {
+        p[0] = pixel & 0xff;
+        p[1] = (pixel >> 8) & 0xff;
+        p[2] = (pixel >> 16) & 0xff;
+      }
+    }
+    else if (bpp == 4)
+    {
+      *(Uint32 *) p = pixel;
+    }
+  }
+}
+
+
+
+/* Draw a line segment, rotated around a center point: */
+
+void draw_segment(int r1, int a1,
+                  color_type c1,
+                  int r2, int a2, color_type c2, int cx, int cy, int a)
+{
+  int x1, y1, x2, y2;
+
+  x1 = ((fast_cos(a1 + a) * r1) >> 10) + cx;
+  y1 = cy - ((fast_sin(a1 + a) * r1) >> 10);
+  x2 = ((fast_cos(a2 + a) * r2) >> 10) + cx;
+  y2 = cy - ((fast_sin(a2 + a) * r2) >> 10);
+
+  /* (Both ends are within the larger radius of the center) */
+
+  bench_segments++;
+
+  if (drawing_on_screen ||
+      cull_circle(cx, cy, (r1 > r2 ? r1 : r2)) == CULL_INSIDE)
+  {
+    bench_segments_fast++;
+    draw_line_on_screen(x1, y1, c1, x2, y2, c2);
+  }
+  else
+  {
+    draw_line(x1, y1, c1, x2, y2, c2);
+  }
+}
+
+
+/* Set a corner of an outline: */
+
+void set_vertex(vertex_type * v, int r, int a, color_type c)
+{
+  v->r = r;
+  v->a = a;
+  v->c = c;
+}
+
+
+/* Draw an outline through "n" corners (back to the first, if "closed"),
+   rotated around a center point.  Each corner is placed just once: */
+
+void draw_polyline(vertex_type * v, int n, int closed,
+                   int cx, int cy, int a)
+{
+  int i, r, xs[MAX_POLY_VERTS], ys[MAX_POLY_VERTS];
+  color_type cs[MAX_POLY_VERTS];
+
+  r = 0;
+
+  for (i = 0; i < n; i++)
+  {
+    xs[i] = ((fast_cos(v[i].a + a) * v[i].r) >> 10) + cx;
+    ys[i] = cy - ((fast_sin(v[i].a + a) * v[i].r) >> 10);
+    cs[i] = v[i].c;
+
+    if (v[i].r > r)
+      r = v[i].r;
+  }
+
+  draw_polyline_at(xs, ys, cs, n, closed, cx, cy, r);
+}
+
+
+/* Draw an outline through corners already placed, all within "r" of the
+   center point.  Each edge is shaded from one corner's color to the next,
+   and leaves the pixel at its far end to the edge that starts there, so
+   no joint gets drawn twice: */
+
+void draw_polyline_at(int *xs, int *ys, color_type * cs, int n, int closed,
+                      int cx, int cy, int r)
+{
+  int i, j, edges, cull;
+
+  edges = (closed ? n : n - 1);
+  bench_segments = bench_segments + edges;
+
+  if (drawing_on_screen)
+    cull = CULL_INSIDE;
+  else
+    cull = cull_circle(cx, cy, r);
+
+  if (cull == CULL_OUTSIDE)
+    return;
+
+  if (cull == CULL_INSIDE)
+    bench_segments_fast = bench_segments_fast + edges;
+
+  for (i = 0; i < edges; i++)
+  {
+    j = (i + 1) % n;
+
+    /* (An open outline's last edge has nothing after it to draw its end) */
+
+    skipping_line_ends = (closed || i < edges - 1);
+
+#ifdef EMBEDDED
+    /* (Nor, near an edge, might the next one; see clip()) */
+
+    if (cull != CULL_INSIDE)
+      skipping_line_ends = FALSE;
+#endif
+
+    if (cull == CULL_INSIDE)
+      draw_line_on_screen(xs[i], ys[i], cs[i], xs[j], ys[j], cs[j]);
+    else
+      draw_line(xs[i], ys[i], cs[i], xs[j], ys[j], cs[j]);
+  }
+
+  skipping_line_ends = FALSE;
+}
+
+
+/* Add a bullet: */
+
+int add_bullet(int x, int y, int a, int xm, int ym)
+{
+  int i, found;
+
+  found = -1;
+
+  for (i = 0; i < NUM_BULLETS && found == -1; i++)
+  {
+    if (bullets[i].timer <= 0)
+      found = i;
+  }
+
+  if (found != -1)
+  {
+#ifndef EMBEDDED
+    bullets[found].timer = 50;
+#else
+    bullets[found].timer = 30;
+#endif
+
+    bullets[found].x = x;
+    bullets[found].y = y;
+
+    bullets[found].xm = ((fast_cos(a) * 5) >> 10) + (xm >> 4);
+    bullets[found].ym = -((fast_sin(a) * 5) >> 10) + (ym >> 4);
+
+
+    playsound(SND_BULLET);
+  }
+
+  return (found != -1);
+}
+
+
+/* Add an asteroid: */
+
+void add_asteroid(int x, int y, int xm, int ym, int size)
+{
+  int i, found;
+
+
+  /* Find a slot: */
+
+  found = -1;
+
+  for (i = 0; i < NUM_ASTEROIDS && found == -1; i++)
+  {
+    if (asteroids[i].alive == 0)
+      found = i;
+  }
+
+
+  /* Hack: No asteroids should be stationary! */
+
+  while (xm == 0)
+  {
+    xm = (rand() % 3) - 1;
+  }
+
+
+  if (found != -1)
+  {
+    asteroids[found].alive = 1;
+
+    asteroids[found].x = x;
+    asteroids[found].y = y;
+    asteroids[found].xm = xm;
+    asteroids[found].ym = ym;
+
+    asteroids[found].angle = (rand() % 360);
+    asteroids[found].angle_m = (rand() % 6) - 3;
+
+    asteroids[found].size = size;
+
+    for (i = 0; i < AST_SIDES; i++)
+    {
+      asteroids[found].shape[i].radius = (rand() % 3);
+      asteroids[found].shape[i].angle = i * 60 + (rand() % 40);
+    }
+
+    build_rock_verts(found);
+  }
+}
+
+
+/* Add a bit: */
+
+void add_bit(int x, int y, int xm, int ym)
+{
+  int i, found;
+
+  found = -1;
+
+  for (i = 0; i < NUM_BITS && found == -1; i++)
+  {
+    if (bits[i].timer <= 0)
+      found = i;
+  }
+
+
+  if (found != -1)
+  {
+    bits[found].timer = 16;
+
+    bits[found].x = x;
+    bits[found].y = y;
+    bits[found].xm = xm;
+    bits[found].ym = ym;
+  }
+}
+
+
+/* Work out where an asteroid's corners sit at every rotation, once, so
+   drawing it needs no trig; its shape never changes while it's alive: */
+
+void build_rock_verts(int i)
+{
+  int j, r, rot;
+  rock_verts_type *v;
+
+  v = &rock_verts[i];
+
+  for (j = 0; j < AST_SIDES; j++)
+  {
+    r = asteroids[i].size * (AST_RADIUS - asteroids[i].shape[j].radius);
+
+    for (rot = 0; rot < NUM_ROTATIONS; rot++)
+    {
+      v->x[j][rot] = (fast_cos(rot) * r) >> 10;
+      v->y[j][rot] = -((fast_sin(rot) * r) >> 10);
+    }
+  }
+
+  v->built = TRUE;
+}
+
+
+/* Draw an asteroid: */
+
+void draw_asteroid(int i)
+{
+  int j, b, cull, size, x, y, angle, rot;
+  int xs[AST_SIDES], ys[AST_SIDES];
+  color_type cs[AST_SIDES];
+  int div;
+  shape_type *shape;
+  rock_verts_type *v;
+
+#ifndef EMBEDDED
+  div = 240;
+#else
+  div = 120;
+#endif
+
+  size = asteroids[i].size;
+  x = asteroids[i].x;
+  y = asteroids[i].y;
+  angle = asteroids[i].angle;
+  shape = asteroids[i].shape;
+
+
+  /* (No corner sticks out further than size * AST_RADIUS) */
+
+  cull = cull_circle(x, y, size * AST_RADIUS);
+
+  if (cull == CULL_OUTSIDE)
+    return;
+
+
+  /* (Rocks restored from a saved game have no corners worked out yet) */
+
+  v = &rock_verts[i];
+
+  if (!v->built)
+    build_rock_verts(i);
+
+
+  /* Place (and shade) each corner: */
+
+  for (j = 0; j < AST_SIDES; j++)
+  {
+    rot = (shape[j].angle + angle) % NUM_ROTATIONS;
+    b = (((shape[j].angle + angle) % 180) * 255) / div;
+
+    xs[j] = x + v->x[j][rot];
+    ys[j] = y + v->y[j][rot];
+    cs[j] = mkcolor(b, b, b);
+  }
+
+  drawing_on_screen = (cull == CULL_INSIDE);
+  draw_polyline_at(xs, ys, cs, AST_SIDES, TRUE, x, y, size * AST_RADIUS);
+  drawing_on_screen = FALSE;
+}
+
+
+/* Queue a sound! */
+
+void playsound(int snd)
+{
+  int which;
+#ifndef EMBEDDED
+  int i;
+#endif
+
+#ifndef NOSOUND
+  if (use_sound)
+  {
+#ifdef EMBEDDED
+    which = -1;
+#else
+    which = (rand() % 3) + CHAN_THRUST;
+    for (i = CHAN_THRUST; i < 4; i++)
+    {
+      if (!Mix_Playing(i))
+        which = i;
+    }
+#endif
+
+    Mix_PlayChannel(which, sounds[snd], 0);
+  }
+#endif
+}
+
+
+/* Break an asteroid and add an explosion: */
+
+void hurt_asteroid(int j, int xm, int ym, int exp_size)
+{
+  int k;
+
+  add_score(100 / (asteroids[j].size + 1));
+
+  if (asteroids[j].size > 1)
+  {
+    /* Break the rock into two smaller ones! */
+
+    add_asteroid(asteroids[j].x,
+                 asteroids[j].y,
+                 ((asteroids[j].xm + xm) / 2),
+                 (asteroids[j].ym + ym), asteroids[j].size - 1);
+
+    add_asteroid(asteroids[j].x,
+                 asteroids[j].y,
+                 (asteroids[j].xm + xm),
+                 ((asteroids[j].ym + ym) / 2), asteroids[j].size - 1);
+  }
+
+
+  /* Make the original go away (and let go of its corners): */
+
+  asteroids[j].alive = 0;
+  rock_verts[j].built = FALSE;
+
+
+  /* Add explosion: */
+
+  playsound(SND_AST1 + (asteroids[j].size) - 1);
+
+  for (k = 0; k < exp_size; k++)
+  {
+    add_bit((asteroids[j].x -
+             (asteroids[j].size * AST_RADIUS) +
+             (rand() % (AST_RADIUS * 2))),
+            (asteroids[j].y -
+             (asteroids[j].size * AST_RADIUS) +
+             (rand() % (AST_RADIUS * 2))),
+            ((rand() % (asteroids[j].size * 3)) -
+             (asteroids[j].size) +
+             ((xm + asteroids[j].xm) / 3)),
+            ((rand() % (asteroids[j].size * 3)) -
+             (asteroids[j].size) + ((ym + asteroids[j].ym) / 3)));
+  }
+}
+
+
+/* Increment score: */
+
+void add_score(int amount)
+{
+  /* See if they deserve a new life: */
+
+  if (score / ONEUP_SCORE < (score + amount) / ONEUP_SCORE)
   {
     lives++;
     strcpy(zoom_str, "EXTRA LIFE");
@@ -3037,62 +6102,653 @@ void add_score(int amount)
 
 
 
-  /* Add to score: */
+  /* Add to score: */
+
+  score = score + amount;
+}
+
+
+/* Draw a character: */
+
+void draw_char(char c, int x, int y, int r, color_type cl)
+{
+  int i, v;
+
+  /* Which vector is this character? */
+
+  v = -1;
+  if (c >= '0' && c <= '9')
+    v = (c - '0');
+  else if (c >= 'A' && c <= 'Z')
+    v = (c - 'A') + 10;
+  else if (c == '.')
+    v = 36;
+
+
+  if (v != -1 && r >= 0 && r <= MAX_GLYPH_SIZE &&
+      x >= 0 && x + r < WIDTH && y >= 0 && y + r * 2 < HEIGHT)
+  {
+    /* On the screen, at a size that can be cached: blit it */
+
+    if (find_glyph(v, r) != NULL)
+    {
+      record_glyph(v, r, x, y, cl);
+      return;
+    }
+  }
+
+
+  if (v != -1)
+  {
+    for (i = 0; i < 5; i++)
+    {
+      if (char_vectors[v][i][0] != -1)
+      {
+        draw_line(x + (char_vectors[v][i][0] * r),
+                  y + (char_vectors[v][i][1] * r),
+                  cl,
+                  x + (char_vectors[v][i][2] * r),
+                  y + (char_vectors[v][i][3] * r), cl);
+      }
+    }
+  }
+}
+
+
+
+/* Find a character's glyph at a given size, caching it first if need be
+   (returns NULL if the cache is full).  Glyphs are never evicted, so the
+   renderer can safely read them while the simulation adds more: */
+
+glyph_type *find_glyph(int v, int r)
+{
+  int i;
+  glyph_type *g;
+
+  g = &glyphs[v][r];
+
+  if (g->num_runs == 0)
+  {
+    g->first = num_glyph_runs;
+
+    /* (Once a stroke doesn't fit, the glyph's runs are given back, and
+       the rest of its strokes aren't tried) */
+
+    for (i = 0; i < 5 && g->num_runs == 0; i++)
+    {
+      if (char_vectors[v][i][0] != -1)
+      {
+        if (!glyph_stroke(char_vectors[v][i][0] * r,
+                          char_vectors[v][i][1] * r,
+                          char_vectors[v][i][2] * r,
+                          char_vectors[v][i][3] * r))
+        {
+          num_glyph_runs = g->first;
+          g->num_runs = -1;
+        }
+      }
+    }
+
+    if (g->num_runs == 0)
+      g->num_runs = num_glyph_runs - g->first;
+  }
+
+  if (g->num_runs < 0)
+    return (NULL);
+
+  return (g);
+}
+
+
+/* Add a stroke's runs to the glyph cache.  (These are the same steps
+   rasterize_line() takes for a whole line, so a blitted glyph matches a
+   drawn one.)  Returns FALSE if there's no room: */
+
+int glyph_stroke(int x1, int y1, int x2, int y2)
+{
+  int dx, dy, sx, x, ya, yb, dq, dm, err, k, k1, run_x, ok;
+
+  k1 = line_steps(x1, y1, x2, y2);
+
+  dx = x2 - x1;
+  dy = y2 - y1;
+
+  sx = 1;
+  if (dx < 0)
+  {
+    sx = -1;
+    dx = -dx;
+  }
+
+  if (dx == 0)
+    return (glyph_run(x1, y1, x1, y2));
+
+  dq = dy / dx;
+  dm = dy % dx;
+  if (dm < 0)
+  {
+    dq--;
+    dm = dm + dx;
+  }
+
+  x = x1;
+  ya = y1;
+  err = 0;
+  run_x = x;
+  ok = TRUE;
+
+  for (k = 0; k <= k1; k++)
+  {
+    yb = ya + dq;
+    err = err + dm;
+    if (err >= dx)
+    {
+      err = err - dx;
+      yb++;
+    }
+
+    if (abs(dy) > dx)
+    {
+      /* Steep: one vertical run per column */
+
+      ok = ok && glyph_run(x, ya, x, yb);
+    }
+    else if (yb != ya)
+    {
+      /* Shallow: one horizontal run per row */
+
+      ok = ok && glyph_run(run_x, ya, x, ya);
+      run_x = x;
+    }
+
+    x = x + sx;
+    ya = yb;
+  }
+
+  if (abs(dy) <= dx)
+    ok = ok && glyph_run(run_x, ya, x - sx, ya);
+
+  return (ok);
+}
+
+
+/* Add a run, from (xa, ya) to (xb, yb) (across or down), to the glyph
+   cache; returns FALSE if there's no room: */
+
+int glyph_run(int xa, int ya, int xb, int yb)
+{
+  glyph_run_type *run;
+
+  if (num_glyph_runs >= MAX_GLYPH_RUNS)
+    return (FALSE);
+
+  run = &glyph_runs[num_glyph_runs++];
+
+  run->x = (xa < xb ? xa : xb);
+  run->y = (ya < yb ? ya : yb);
+  run->w = abs(xb - xa) + 1;
+  run->h = abs(yb - ya) + 1;
+
+  return (TRUE);
+}
+
+
+/* Add a glyph to the display list: */
+
+void record_glyph(int v, int r, int x, int y, color_type cl)
+{
+  draw_cmd_type *cmd;
+
+  cmd = new_draw_cmd();
+
+  cmd->x1 = x;
+  cmd->y1 = y;
+  cmd->x2 = x + r;
+  cmd->y2 = y + r * 2;
+  cmd->k0 = v;
+  cmd->k1 = r;
+  cmd->c1 = cl;
+  cmd->c2 = cl;
+  cmd->kind = DRAW_GLYPH;
+}
+
+
+/* Draw a glyph's runs that fall within rows "top" up to (but not including)
+   "bottom", tinted its color: */
+
+void blit_glyph(draw_cmd_type *cmd, int top_row, int bottom_row)
+{
+  int i, top, bot;
+  glyph_type *g;
+  glyph_run_type *run;
+  shade_type sh;
+
+  g = &glyphs[cmd->k0][cmd->k1];
+  mkshade(&sh, cmd->c1, cmd->c1, 0);
+
+  for (i = 0; i < g->num_runs; i++)
+  {
+    run = &glyph_runs[g->first + i];
+
+    top = cmd->y1 + run->y;
+    bot = top + run->h;
+
+    if (top < top_row)
+      top = top_row;
+    if (bot > bottom_row)
+      bot = bottom_row;
+
+    if (top < bot)
+    {
+      if (run->h == 1)
+        drawhorizline(cmd->x1 + run->x, top, run->w, &sh);
+      else
+        drawvertline(cmd->x1 + run->x, top, bot - top, &sh);
+    }
+  }
+}
+
+
+#define CHAR_SPACING 4
+
+void draw_text(char *str, int x, int y, int s, color_type c)
+{
+  int i;
+
+  for (i = 0; i < strlen(str); i++)
+    draw_char(str[i], i * (s + CHAR_SPACING) + x, y, s, c);
+}
+
+
+void draw_thick_line(int x1, int y1, color_type c1,
+                     int x2, int y2, color_type c2)
+{
+  draw_line(x1, y1, c1, x2, y2, c2);
+  draw_line(x1 + 1, y1, c1, x2 + 1, y2, c2);
+  draw_line(x1 + 1, y1 + 1, c1, x2 + 1, y2 + 1, c2);
+}
+
+
+/* Make up some sparkles for bullets, just as random as the ones game()
+   used to make up for each bullet every frame, and draw each once (with
+   the real line code, in the screen's corner) to see how it comes out: */
+
+void build_sparkles(void)
+{
+  int i, j, x, y;
+  sparkle_type *sp;
+
+  for (i = 0; i < NUM_SPARKLES * 2; i++)
+  {
+    sp = &sparkles[i];
+
+    if (i < NUM_SPARKLES)
+    {
+      /* (A trail: thin, dark or bright) */
+
+      sp->thick = FALSE;
+
+      for (j = 0; j < 4; j++)
+      {
+        sp->x[j] = (rand() % 3);
+        sp->y[j] = (rand() % 3);
+        sp->c[j] = mkcolor((rand() % 3) * 128,
+                           (rand() % 3) * 128, (rand() % 3) * 128);
+      }
+    }
+    else
+    {
+      /* (The bullet: thick, never dark) */
+
+      sp->thick = TRUE;
+
+      for (j = 0; j < 4; j++)
+      {
+        sp->x[j] = (rand() % 5);
+        sp->y[j] = (rand() % 5);
+        sp->c[j] = mkcolor((rand() % 3) * 128 + 64,
+                           (rand() % 3) * 128 + 64,
+                           (rand() % 3) * 128 + 64);
+      }
+    }
+
+    sp->x[0] = -sp->x[0];
+    sp->y[0] = -sp->y[0];
+    sp->y[2] = -sp->y[2];
+    sp->x[3] = -sp->x[3];
+
+    clear_coverage();
+    draw_sparkle_lines(sp, SPARKLE_CENTER, SPARKLE_CENTER);
+    flush_draw_cmds(record_list);
+
+    for (y = 0; y < SPARKLE_SIZE; y++)
+    {
+      sp->mask[y] = 0;
+
+      for (x = 0; x < SPARKLE_SIZE; x++)
+      {
+        if (COVERED(x, y))
+        {
+          sp->mask[y] = sp->mask[y] | (1 << x);
+
+          if (use_indexed)
+          {
+            sp->indices[y][x] = index_rows[y][x];
+            sp->pixels[y][x] = palette[index_rows[y][x]];
+          }
+          else
+          {
+            sp->pixels[y][x] = screen_rows[y][x];
+          }
+        }
+      }
+    }
+  }
+
+  clear_coverage();
+}
+
+
+/* A quick pseudo-random number (0 through 65535) for picking sparkles: */
+
+int sparkle_rand(void)
+{
+  sparkle_seed = sparkle_seed ^ (sparkle_seed << 13);
+  sparkle_seed = sparkle_seed ^ (sparkle_seed >> 17);
+  sparkle_seed = sparkle_seed ^ (sparkle_seed << 5);
+
+  return (sparkle_seed >> 16);
+}
+
+
+/* Draw a sparkle, centered at (x, y): */
+
+void draw_sparkle(int v, int x, int y)
+{
+  draw_cmd_type *cmd;
+
+  x = x - SPARKLE_CENTER;
+  y = y - SPARKLE_CENTER;
+
+  if (x < 0 || y < 0 || x + SPARKLE_SIZE > WIDTH ||
+      y + SPARKLE_SIZE > HEIGHT)
+  {
+    /* (Near the edge, it's lines again, so it can wrap around) */
+
+    draw_sparkle_lines(&sparkles[v], x + SPARKLE_CENTER, y + SPARKLE_CENTER);
+    return;
+  }
+
+  cmd = new_draw_cmd();
+
+  cmd->x1 = x;
+  cmd->y1 = y;
+  cmd->x2 = x + SPARKLE_SIZE - 1;
+  cmd->y2 = y + SPARKLE_SIZE - 1;
+  cmd->k0 = v;
+  cmd->kind = DRAW_SPARKLE;
+}
+
+
+/* Draw a sparkle's lines, centered at (x, y): */
+
+void draw_sparkle_lines(sparkle_type * sp, int x, int y)
+{
+  if (sp->thick)
+  {
+    draw_thick_line(x + sp->x[0], y + sp->y[0], sp->c[0],
+                    x + sp->x[1], y + sp->y[1], sp->c[1]);
+    draw_thick_line(x + sp->x[2], y + sp->y[2], sp->c[2],
+                    x + sp->x[3], y + sp->y[3], sp->c[3]);
+  }
+  else
+  {
+    draw_line(x + sp->x[0], y + sp->y[0], sp->c[0],
+              x + sp->x[1], y + sp->y[1], sp->c[1]);
+    draw_line(x + sp->x[2], y + sp->y[2], sp->c[2],
+              x + sp->x[3], y + sp->y[3], sp->c[3]);
+  }
+}
+
+
+/* Copy the rows of a sparkle that fall within rows "top" up to (but not
+   including) "bottom" onto the screen: */
+
+void blit_sparkle(draw_cmd_type *cmd, int top_row, int bottom_row)
+{
+  int y, row, i, n, j;
+  sparkle_type *sp;
+
+  sp = &sparkles[cmd->k0];
+
+  for (y = cmd->y1; y <= cmd->y2; y++)
+  {
+    if (y < top_row || y >= bottom_row)
+      continue;
+
+    row = y - cmd->y1;
+    i = 0;
+
+    while (i < SPARKLE_SIZE)
+    {
+      /* (Find each run of drawn pixels along the row) */
+
+      if ((sp->mask[row] & (1 << i)) == 0)
+      {
+        i++;
+        continue;
+      }
+
+      n = 1;
+      while (i + n < SPARKLE_SIZE && (sp->mask[row] & (1 << (i + n))))
+        n++;
+
+      if (use_indexed)
+      {
+        memcpy(index_rows[y] + cmd->x1 + i, &sp->indices[row][i], n);
+      }
+      else if (screen_native)
+      {
+        memcpy(screen_rows[y] + cmd->x1 + i, &sp->pixels[row][i],
+               n * sizeof(pixel_type));
+      }
+      else
+      {
+        for (j = i; j < i + n; j++)
+          putpixel(screen, cmd->x1 + j, y, sp->pixels[row][j]);
+      }
+
+      cover_horiz(cmd->x1 + i, y, n);
+      i = i + n;
+    }
+  }
+}
+
+
+/* Draw a short segment, from (x, y) to (x + xm, y + ym), wrapping around
+   the edges of the screen.  Segments drawn one after another (as all the
+   explosion bits are) go into a single batch command: */
+
+void draw_bit(int x, int y, int xm, int ym, color_type c)
+{
+  int top, bottom;
+  draw_cmd_type *cmd;
+  bit_seg_type *seg;
 
-  score = score + amount;
+  /* (Each explosion bit draws one segment a frame, so with only NUM_BITS
+     of them this can't fill; but just in case...) */
+
+  if (record_list->num_bit_segs >= MAX_BIT_SEGS)
+    return;
+
+  top = (ym < 0 ? y + ym : y);
+  bottom = (ym < 0 ? y : y + ym);
+
+  if (top < 0 || bottom >= HEIGHT)
+  {
+    /* (It wraps around, top to bottom) */
+
+    top = 0;
+    bottom = HEIGHT - 1;
+  }
+
+  cmd = NULL;
+
+  if (record_list->num_cmds > 0)
+  {
+    cmd = &record_list->cmds[record_list->num_cmds - 1];
+
+    if (cmd->kind != DRAW_BITS ||
+        cmd->k0 + cmd->k1 != record_list->num_bit_segs ||
+        cmd->c1.r != c.r || cmd->c1.g != c.g || cmd->c1.b != c.b)
+      cmd = NULL;
+  }
+
+  if (cmd == NULL)
+  {
+    /* (Start a new batch) */
+
+    cmd = new_draw_cmd();
+
+    cmd->kind = DRAW_BITS;
+    cmd->k0 = record_list->num_bit_segs;
+    cmd->k1 = 0;
+    cmd->c1 = c;
+    cmd->c2 = c;
+    cmd->x1 = 0;
+    cmd->x2 = WIDTH - 1;
+    cmd->y1 = top;
+    cmd->y2 = bottom;
+  }
+
+  if (top < cmd->y1)
+    cmd->y1 = top;
+  if (bottom > cmd->y2)
+    cmd->y2 = bottom;
+
+  seg = &record_list->bit_segs[record_list->num_bit_segs++];
+
+  seg->x = x;
+  seg->y = y;
+  seg->xm = xm;
+  seg->ym = ym;
+
+  cmd->k1++;
 }
 
 
-/* Draw a character: */
+/* Plot a batch of short segments, within rows "top" up to (but not
+   including) "bottom".  Each covers just what rasterize_line() would
+   (in each column but the last, the rows from where the line enters it
+   to where it leaves), but a pixel at a time, stepping in integers, with
+   each pixel wrapped onto the screen by itself: */
 
-void draw_char(char c, int x, int y, int r, color_type cl)
+void plot_bits(draw_cmd_type *cmd, int top_row, int bottom_row)
 {
-  int i, v;
+  int i, k, x, ya, yb, y, dx, dy, sx, dq, dm, err;
+  Uint32 pixel;
+  bit_seg_type *seg;
+
+  if (use_indexed)
+    pixel = COLOR_INDEX(cmd->c1.r, cmd->c1.g, cmd->c1.b);
+  else if (screen_native)
+    pixel = PIXEL(cmd->c1.r, cmd->c1.g, cmd->c1.b);
+  else
+    pixel = SDL_MapRGB(screen->format, cmd->c1.r, cmd->c1.g, cmd->c1.b);
 
-  /* Which vector is this character? */
+  for (i = cmd->k0; i < cmd->k0 + cmd->k1; i++)
+  {
+    seg = &flush_list->bit_segs[i];
 
-  v = -1;
-  if (c >= '0' && c <= '9')
-    v = (c - '0');
-  else if (c >= 'A' && c <= 'Z')
-    v = (c - 'A') + 10;
-  else if (c == '.')
-    v = 36;
+    dx = seg->xm;
+    dy = seg->ym;
 
+    if (dx == 0)
+    {
+      /* (Vertical, or a single dot: every row, ends and all) */
 
-  if (v != -1)
-  {
-    for (i = 0; i < 5; i++)
+      sx = (dy < 0 ? -1 : 1);
+
+      for (k = 0; k <= abs(dy); k++)
+        plot_bit_pixel(seg->x, seg->y + k * sx, pixel, top_row, bottom_row);
+
+      continue;
+    }
+
+    sx = 1;
+    if (dx < 0)
     {
-      if (char_vectors[v][i][0] != -1)
+      sx = -1;
+      dx = -dx;
+    }
+
+    dq = dy / dx;
+    dm = dy % dx;
+    if (dm < 0)
+    {
+      dq--;
+      dm = dm + dx;
+    }
+
+    x = seg->x;
+    ya = seg->y;
+    err = 0;
+
+    for (k = 0; k < dx; k++)
+    {
+      yb = ya + dq;
+      err = err + dm;
+      if (err >= dx)
       {
-        draw_line(x + (char_vectors[v][i][0] * r),
-                  y + (char_vectors[v][i][1] * r),
-                  cl,
-                  x + (char_vectors[v][i][2] * r),
-                  y + (char_vectors[v][i][3] * r), cl);
+        err = err - dx;
+        yb++;
+      }
+
+      if (ya <= yb)
+      {
+        for (y = ya; y <= yb; y++)
+          plot_bit_pixel(x, y, pixel, top_row, bottom_row);
+      }
+      else
+      {
+        for (y = yb; y <= ya; y++)
+          plot_bit_pixel(x, y, pixel, top_row, bottom_row);
       }
+
+      x = x + sx;
+      ya = yb;
     }
   }
 }
 
-#define CHAR_SPACING 4
-
-void draw_text(char *str, int x, int y, int s, color_type c)
-{
-  int i;
-
-  for (i = 0; i < strlen(str); i++)
-    draw_char(str[i], i * (s + CHAR_SPACING) + x, y, s, c);
-}
 
+/* Plot (and cover) one pixel of a short segment, wrapped onto the screen,
+   if it lands within rows "top" up to (but not including) "bottom": */
 
-void draw_thick_line(int x1, int y1, color_type c1,
-                     int x2, int y2, color_type c2)
+void plot_bit_pixel(int x, int y, Uint32 pixel, int top_row, int bottom_row)
 {
-  draw_line(x1, y1, c1, x2, y2, c2);
-  draw_line(x1 + 1, y1, c1, x2 + 1, y2, c2);
-  draw_line(x1 + 1, y1 + 1, c1, x2 + 1, y2 + 1, c2);
+  if (x < 0)
+    x = x + WIDTH;
+  else if (x >= WIDTH)
+    x = x - WIDTH;
+
+  if (y < 0)
+    y = y + HEIGHT;
+  else if (y >= HEIGHT)
+    y = y - HEIGHT;
+
+  if (y < top_row || y >= bottom_row)
+    return;
+
+  if (use_indexed)
+    index_rows[y][x] = pixel;
+  else if (screen_native)
+    screen_rows[y][x] = pixel;
+  else
+    putpixel(screen, x, y, pixel);
+
+  cover_row(y, x >> 5, x >> 5);
+  coverage[y][x >> 5] = coverage[y][x >> 5] | ((Uint32) 1 << (x & 31));
 }
 
 
@@ -3105,7 +6761,10 @@ void reset_level(void)
     bullets[i].timer = 0;
 
   for (i = 0; i < NUM_ASTEROIDS; i++)
+  {
     asteroids[i].alive = 0;
+    rock_verts[i].built = FALSE;
+  }
 
   for (i = 0; i < NUM_BITS; i++)
     bits[i].timer = 0;
@@ -3134,6 +6793,36 @@ void reset_level(void)
 }
 
 
+/* Wrap everything in a restored game back onto the screen (in case it
+   was saved at a bigger "--render-size"): */
+
+void wrap_saved_state(void)
+{
+  int i;
+
+  x = x % (WIDTH << 4);
+  y = y % (HEIGHT << 4);
+
+  for (i = 0; i < NUM_BULLETS; i++)
+  {
+    bullets[i].x = bullets[i].x % WIDTH;
+    bullets[i].y = bullets[i].y % HEIGHT;
+  }
+
+  for (i = 0; i < NUM_ASTEROIDS; i++)
+  {
+    asteroids[i].x = asteroids[i].x % WIDTH;
+    asteroids[i].y = asteroids[i].y % HEIGHT;
+  }
+
+  for (i = 0; i < NUM_BITS; i++)
+  {
+    bits[i].x = bits[i].x % WIDTH;
+    bits[i].y = bits[i].y % HEIGHT;
+  }
+}
+
+
 /* Show program version: */
 
 void show_version(void)
@@ -3147,7 +6836,13 @@ void show_version(void)
 void show_usage(FILE *f, char *prg)
 {
   fprintf(f, "Usage: %s {--help | --usage | --version | --copying }\n"
-          "       %s [--fullscreen] [--nosound]\n\n", prg, prg);
+          "       %s [--fullscreen] [--nosound] [--seed N] [--threads N]\n"
+          "          [--zero-copy] [--renderer=soft|sdl]\n"
+          "          [--render-size WxH] [--indexed]\n"
+          "       %s --bench FRAMES [--seed N] [--threads N] [--nosound]\n"
+          "          [--zero-copy] [--renderer=soft|sdl]\n"
+          "          [--render-size WxH] [--indexed]\n"
+          "\n", prg, prg, prg);
 }
 
 
@@ -3156,21 +6851,205 @@ void show_usage(FILE *f, char *prg)
 void set_vid_mode(unsigned flags)
 {
   char str[64];
+  int scale;
+
+  /* (A small "--render-size" is shown at a whole multiple of its size,
+     as near the usual window size as fits) */
+
+  scale = 1;
+
+  while (WIDTH * (scale + 1) <= DEFAULT_WIDTH &&
+         HEIGHT * (scale + 1) <= DEFAULT_HEIGHT)
+    scale++;
 
   /* Prefer 16bpp, but also prefer native modes to emulated 16bpp. */
 
   snprintf(str, sizeof(str), "Vectorids %s", VER_VERSION);
   window = SDL_CreateWindow(str,
                             SDL_WINDOWPOS_UNDEFINED,
-                            SDL_WINDOWPOS_UNDEFINED, WIDTH, HEIGHT, flags);
+                            SDL_WINDOWPOS_UNDEFINED,
+                            WIDTH * scale, HEIGHT * scale, flags);
   renderer = SDL_CreateRenderer(window, -1, 0);
-  screen = SDL_CreateRGBSurface(0, WIDTH, HEIGHT, 32,
-                                0x00FF0000,
-                                0x0000FF00, 0x000000FF, 0xFF000000);
+  SDL_RenderSetLogicalSize(renderer, WIDTH, HEIGHT);
+  screen = SDL_CreateRGBSurfaceWithFormat(0, WIDTH, HEIGHT,
+                                          SDL_BITSPERPIXEL(SCREEN_FORMAT),
+                                          SCREEN_FORMAT);
   screenTexture = SDL_CreateTexture(renderer,
-                                    SDL_PIXELFORMAT_ARGB8888,
+                                    SCREEN_FORMAT,
                                     SDL_TEXTUREACCESS_STREAMING,
                                     WIDTH, HEIGHT);
+
+  /* (If there's no screen, setup() falls back or gives up) */
+
+  if (screen == NULL)
+    return;
+
+  setup_screen_rows();
+  setup_dirty_tiles();
+
+  raster_top = 0;
+  raster_bottom = HEIGHT;
+
+  if (use_indexed && index_screen == NULL)
+    setup_index_screen();
+}
+
+
+/* Move the mouse pointer to a spot on the (scaled) screen: */
+
+void warp_mouse(int x, int y)
+{
+  int wx, wy;
+#ifndef RENDER_GEOMETRY
+  SDL_Rect view;
+  float sx, sy;
+#endif
+
+#ifdef RENDER_GEOMETRY
+  SDL_RenderLogicalToWindow(renderer, x, y, &wx, &wy);
+#else
+  /* (Before SDL 2.0.18, work it out from the renderer's scale) */
+
+  SDL_RenderGetViewport(renderer, &view);
+  SDL_RenderGetScale(renderer, &sx, &sy);
+  wx = (x + view.x) * sx;
+  wy = (y + view.y) * sy;
+#endif
+
+  SDL_WarpMouseInWindow(window, wx, wy);
+}
+
+
+/* Point a table at the start of each of "screen"'s rows, and note
+   whether the span kernels can write its pixels directly: */
+
+void setup_screen_rows(void)
+{
+  int y;
+
+  for (y = 0; y < HEIGHT; y++)
+    screen_rows[y] = (pixel_type *) ((Uint8 *) screen->pixels +
+                                     y * screen->pitch);
+
+  screen_stride = screen->pitch / sizeof(pixel_type);
+  screen_native = (screen->format->format == SCREEN_FORMAT &&
+                   screen->pitch % sizeof(pixel_type) == 0);
+  shadow_pixel = SDL_MapRGB(screen->format, 0, 0, 0);
+}
+
+
+/* With "--indexed", draw into a byte per pixel (see span_shade_index()),
+   expanded to the screen texture's pixels only as it's uploaded: */
+
+void setup_index_screen(void)
+{
+  int y;
+
+  index_screen = SDL_CreateRGBSurfaceWithFormat(0, WIDTH, HEIGHT, 8,
+                                                SDL_PIXELFORMAT_INDEX8);
+  if (index_screen == NULL)
+  {
+    fprintf(stderr,
+            "\nError: I couldn't make an indexed screen!\n"
+            "The Simple DirectMedia error that occured was:\n"
+            "%s\n\n", SDL_GetError());
+    exit(1);
+  }
+
+  for (y = 0; y < HEIGHT; y++)
+    index_rows[y] = (Uint8 *) index_screen->pixels + y * index_screen->pitch;
+
+  index_stride = index_screen->pitch;
+  SDL_FillRect(index_screen, NULL, 0);
+
+  build_palette();
+}
+
+
+/* The palette:  0 is see-through, then come a ramp of grays (for rocks,
+   text and shadows), ramps of the ship's blues and the thrust's reds, and
+   a small color cube for everything else.  Each 15-bit color gets the
+   nearest of them (never 0): */
+
+void build_palette(void)
+{
+  int i, n, v, r, g, b, dr, dg, db, dist, best, best_dist;
+  color_type pal[256];
+
+  n = 0;
+  pal[n++] = mkcolor(0, 0, 0);
+
+  for (i = 0; i < NUM_PALETTE_GRAYS; i++)
+  {
+    v = i * 255 / (NUM_PALETTE_GRAYS - 1);
+    pal[n++] = mkcolor(v, v, v);
+  }
+
+  for (i = 0; i < NUM_PALETTE_RAMP; i++)
+  {
+    v = i * 128 / (NUM_PALETTE_RAMP - 1);
+    pal[n++] = mkcolor(v, v, 192 + i * 63 / (NUM_PALETTE_RAMP - 1));
+  }
+
+  for (i = 0; i < NUM_PALETTE_RAMP; i++)
+  {
+    v = i * 255 / (NUM_PALETTE_RAMP - 1);
+    pal[n++] = mkcolor(255, v, v);
+  }
+
+  for (r = 0; r < PALETTE_CUBE; r++)
+  {
+    for (g = 0; g < PALETTE_CUBE; g++)
+    {
+      for (b = 0; b < PALETTE_CUBE; b++)
+      {
+        pal[n++] = mkcolor(r * 255 / (PALETTE_CUBE - 1),
+                           g * 255 / (PALETTE_CUBE - 1),
+                           b * 255 / (PALETTE_CUBE - 1));
+      }
+    }
+  }
+
+  for (i = 0; i < 256; i++)
+  {
+    if (i < n)
+      palette[i] = PIXEL(pal[i].r, pal[i].g, pal[i].b);
+    else
+      palette[i] = PIXEL(0, 0, 0);
+  }
+
+
+  /* (Green counts most, then red, then blue) */
+
+  for (r = 0; r < 32; r++)
+  {
+    for (g = 0; g < 32; g++)
+    {
+      for (b = 0; b < 32; b++)
+      {
+        best = 1;
+        best_dist = -1;
+
+        for (i = 1; i < n; i++)
+        {
+          dr = r * 255 / 31 - pal[i].r;
+          dg = g * 255 / 31 - pal[i].g;
+          db = b * 255 / 31 - pal[i].b;
+          dist = dr * dr * 3 + dg * dg * 4 + db * db * 2;
+
+          if (best_dist < 0 || dist < best_dist)
+          {
+            best = i;
+            best_dist = dist;
+          }
+        }
+
+        color_index[r][g][b] = best;
+      }
+    }
+  }
+
+  shadow_index = COLOR_INDEX(0, 0, 0);
 }
 
 
@@ -3180,3 +7059,174 @@ void draw_centered_text(char *str, int y, int s, color_type c)
 {
   draw_text(str, (WIDTH - strlen(str) * (s + CHAR_SPACING)) / 2, y, s, c);
 }
+
+
+/* Benchmark: run the real game loop headless (no window, no frame delay)
+   for "--bench" frames, then report frame rate and per-phase timings: */
+
+void bench(void)
+{
+  int i, t;
+  Uint64 total, freq;
+  double secs, phase_secs, raster_secs[MAX_THREADS + 1], soft_secs;
+
+
+  freq = SDL_GetPerformanceFrequency();
+  total = 0;
+  soft_secs = 0;
+
+
+  /* With "--renderer=sdl", play the same game (so, the same frames) with
+     the software rasterizer first, to compare: */
+
+  if (use_sdl_renderer)
+  {
+    use_sdl_renderer = FALSE;
+    raster_threads = num_threads;
+    bench_run();
+    soft_secs = bench_render_secs();
+    use_sdl_renderer = TRUE;
+  }
+
+
+  /* With "--threads", replay the same game using 1, 2, ... threads, to
+     see how rasterization scales; the last run (using them all) is the
+     one reported in full: */
+
+  for (t = 1; t <= num_threads; t++)
+  {
+    raster_threads = t;
+    total = bench_run();
+    raster_secs[t] = (double) bench_time[BENCH_RASTER] / (double) freq;
+  }
+
+  secs = (double) total / (double) freq;
+
+  printf("Vectoroids benchmark: %d frames at %dx%d, seed %d, %d thread%s%s\n",
+         bench_frames, WIDTH, HEIGHT, seed, num_threads,
+         (num_threads == 1 ? "" : "s"),
+         (use_sdl_renderer ? ", SDL renderer" :
+          (use_indexed ? ", indexed" : "")));
+  printf("  %.3f sec total, %.1f frames/sec\n", secs,
+         (double) bench_frames / secs);
+  printf("  (finished on level %d, with score %d)\n", level, score);
+  printf("  %d segments, %.1f%% drawn via the on-screen fast path\n",
+         bench_segments, (bench_segments > 0 ?
+                          bench_segments_fast * 100.0 / bench_segments :
+                          0.0));
+  printf("  %.1f%% of the screen uploaded per frame\n",
+         bench_uploaded * 100.0 / ((double) WIDTH * HEIGHT * bench_frames));
+  printf("  %.1f KB of pixels copied per frame%s\n\n",
+         bench_copied / 1024.0 / bench_frames,
+         (zero_copy ? " (drawing straight into the texture)" : ""));
+
+  for (i = 0; i < NUM_BENCH_PHASES; i++)
+  {
+    phase_secs = (double) bench_time[i] / (double) freq;
+
+    printf("  %-16s %9.3f ms  %8.4f ms/frame  %5.1f%%\n",
+           bench_phase_names[i], phase_secs * 1000.0,
+           phase_secs * 1000.0 / bench_frames, phase_secs * 100.0 / secs);
+  }
+
+  if (num_threads > 1)
+  {
+    printf("\n  rasterization, by number of threads:\n");
+
+    for (t = 1; t <= num_threads; t++)
+    {
+      printf("  %8d         %8.4f ms/frame  %5.2fx\n", t,
+             raster_secs[t] * 1000.0 / bench_frames,
+             raster_secs[1] / raster_secs[t]);
+    }
+  }
+
+  if (use_sdl_renderer)
+  {
+    printf("\n  drawing (rasterization, upload and present), by renderer:\n");
+    printf("  soft             %8.4f ms/frame\n",
+           soft_secs * 1000.0 / bench_frames);
+    printf("  sdl              %8.4f ms/frame  %5.2fx\n",
+           bench_render_secs() * 1000.0 / bench_frames,
+           soft_secs / bench_render_secs());
+  }
+}
+
+
+/* How long the last benchmark run spent drawing (in seconds): */
+
+double bench_render_secs(void)
+{
+  return ((double) (bench_time[BENCH_RASTER] + bench_time[BENCH_UPLOAD] +
+                    bench_time[BENCH_PRESENT]) /
+          (double) SDL_GetPerformanceFrequency());
+}
+
+
+/* One benchmark run, from the start of a fresh game; returns its length
+   (in performance counter ticks): */
+
+Uint64 bench_run(void)
+{
+  int i;
+  Uint64 start;
+
+  srand(seed);
+
+
+  /* (Every run starts as cold as the first, so they all draw the very same
+     frames the very same way:  no glyphs or layers left from the last) */
+
+  memset(glyphs, 0, sizeof(glyphs));
+  num_glyph_runs = 0;
+
+  hud_layer.valid = FALSE;
+  title_layer.valid = FALSE;
+  layer_drawn_serial = 0;
+
+  game_pending = 0;
+  bench_frames_done = 0;
+  bench_segments = 0;
+  bench_segments_fast = 0;
+  bench_uploaded = 0;
+  bench_copied = 0;
+
+  for (i = 0; i < NUM_BENCH_PHASES; i++)
+    bench_time[i] = 0;
+
+  start = SDL_GetPerformanceCounter();
+  bench_last = start;
+
+  while (bench_frames_done < bench_frames)
+    game();
+
+  return (SDL_GetPerformanceCounter() - start);
+}
+
+
+/* Benchmark input: sweep around, thrusting and firing in bursts: */
+
+void bench_input(int counter, int *left, int *right, int *up, int *fire,
+                 int *shift)
+{
+  *left = ((counter / 100) % 2 == 0);
+  *right = !(*left);
+  *up = ((counter % 60) < 15);
+  *fire = ((counter % 8) < 4);
+  *shift = 1;
+}
+
+
+/* Charge time since the last lap to a benchmark phase: */
+
+void bench_lap(int phase)
+{
+  Uint64 now;
+
+  if (bench_frames > 0)
+  {
+    now = SDL_GetPerformanceCounter();
+    bench_time[phase] += now - bench_last;
+    bench_last = now;
+  }
+}